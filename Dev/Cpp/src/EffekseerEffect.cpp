@@ -2,6 +2,9 @@
 #include <ResourceLoader.hpp>
 #include "EffekseerSystem.h"
 #include "EffekseerEffect.h"
+#include "EffekseerResource.h"
+#include "LoaderGodot/EffekseerGodot.MaterialLoader.h"
+#include "RendererGodot/EffekseerGodot.RenderResources.h"
 #include "RendererGodot/../Utils/EffekseerGodot.Utils.h"
 
 namespace godot {
@@ -13,12 +16,18 @@ void EffekseerEffect::_register_methods()
 	register_method("release", &EffekseerEffect::release);
 	register_method("resolve_dependencies", &EffekseerEffect::resolve_dependencies);
 	register_method("setup", &EffekseerEffect::setup);
+	register_method("setup_async", &EffekseerEffect::setup_async);
+	register_method("is_loaded", &EffekseerEffect::is_loaded);
+	register_signal<EffekseerEffect>("loaded", Dictionary());
+	register_signal<EffekseerEffect>("load_failed", Dictionary());
 	register_property<EffekseerEffect, String>("data_path", 
 		&EffekseerEffect::set_data_path, &EffekseerEffect::get_data_path, "");
 	register_property<EffekseerEffect, PoolByteArray>("data_bytes", 
 		&EffekseerEffect::set_data_bytes, &EffekseerEffect::get_data_bytes, {});
 	register_property<EffekseerEffect, Dictionary>("subresources", 
 		&EffekseerEffect::set_subresources, &EffekseerEffect::get_subresources, {});
+	register_property<EffekseerEffect, Dictionary>("baked_materials", 
+		&EffekseerEffect::set_baked_materials, &EffekseerEffect::get_baked_materials, {});
 	register_property<EffekseerEffect, float>("scale", 
 		&EffekseerEffect::set_scale, &EffekseerEffect::get_scale, 1.0f);
 }
@@ -51,6 +60,18 @@ void EffekseerEffect::load(String path)
 	file->close();
 }
 
+PoolByteArray EffekseerEffect::acquire_data()
+{
+	if (m_data_bytes.size() == 0 && !get_path().empty()) {
+		// Bypasses the cache, which would return this resource itself
+		Ref<Resource> resource = ResourceLoader::get_singleton()->load(get_path(), "", true);
+		if (auto reloaded = resource.is_valid() ? as<EffekseerEffect>(resource.ptr()) : nullptr) {
+			m_data_bytes = reloaded->get_data_bytes();
+		}
+	}
+	return m_data_bytes;
+}
+
 void EffekseerEffect::resolve_dependencies()
 {
 	auto setting = Effekseer::Setting::Create();
@@ -85,26 +106,108 @@ void EffekseerEffect::resolve_dependencies()
 	enumerateResouces(&Effekseer::Effect::GetCurvePath, native->GetCurveCount());
 	enumerateResouces(&Effekseer::Effect::GetMaterialPath, native->GetMaterialCount());
 	enumerateResouces(&Effekseer::Effect::GetWavePath, native->GetWaveCount());
+
+	// Godot shaders of the materials are generated here instead of at every setup
+	for (int i = 0; i < native->GetMaterialCount(); i++)
+	{
+		godot::String path = EffekseerGodot::ToGdString(native->GetMaterialPath(i));
+		Ref<EffekseerResource> material = m_subresources[path];
+		if (material.is_null())
+		{
+			continue;
+		}
+
+		auto data = material->acquire_data();
+		auto baked = EffekseerGodot::MaterialLoader::BakeShaders(data.read().ptr(), data.size());
+		if (baked.size() > 0)
+		{
+			m_baked_materials[path] = baked;
+		}
+	}
 }
 
 void EffekseerEffect::setup()
 {
-	if (m_native != nullptr) return;
+	if (m_native != nullptr || m_loading) return;
 
 	auto system = EffekseerSystem::get_instance();
 	if (system == nullptr) return;
 	auto manager = system->get_manager();
 	if (manager == nullptr) return;
 
+	auto native = create_native(manager->GetSetting());
+
+	// The model meshes are created at load time here, setup_async() spreads them over frames instead
+	if (native != nullptr) {
+		for (int32_t i = 0; i < native->GetModelCount(); i++) {
+			if (auto model = native->GetModel(i).DownCast<EffekseerGodot::Model>()) {
+				model->CreateMesh();
+			}
+		}
+	}
+
+	finish_setup(native);
+}
+
+void EffekseerEffect::setup_async()
+{
+	if (m_native != nullptr || m_loading) return;
+
+	auto system = EffekseerSystem::get_instance();
+	if (system == nullptr) return;
+
+	m_loading = true;
+	system->load_effect_async(this);
+}
+
+Effekseer::EffectRef EffekseerEffect::create_native(const Effekseer::SettingRef& setting)
+{
+	// Called on the load thread by setup_async()
 	char16_t materialPath[1024];
 	get_material_path(materialPath, sizeof(materialPath) / sizeof(materialPath[0]));
 
-	m_native = Effekseer::Effect::Create(manager, 
-		m_data_bytes.read().ptr(), (int32_t)m_data_bytes.size(), m_scale, materialPath);
-	if (m_native == nullptr)
+	// The material loader picks up the baked shaders by path while the effect is created
+	auto materialLoader = setting->GetMaterialLoader().DownCast<EffekseerGodot::MaterialLoader>();
+	godot::String materialDir = EffekseerGodot::ToGdString(materialPath) + "/";
+	Array bakedPaths = m_baked_materials.keys();
+	if (materialLoader != nullptr) {
+		for (int i = 0; i < bakedPaths.size(); i++) {
+			materialLoader->AddBakedShaders(materialDir + (String)bakedPaths[i], m_baked_materials[bakedPaths[i]]);
+		}
+	}
+
+	auto data = acquire_data();
+	auto native = Effekseer::Effect::Create(setting, 
+		data.read().ptr(), (int32_t)data.size(), m_scale, materialPath);
+
+	if (materialLoader != nullptr) {
+		for (int i = 0; i < bakedPaths.size(); i++) {
+			materialLoader->RemoveBakedShaders(materialDir + (String)bakedPaths[i]);
+		}
+	}
+	if (native == nullptr)
 	{
 		Godot::print_error(String("Failed load effect: ") + m_data_path, __FUNCTION__, "", __LINE__);
-		return;
+	}
+	return native;
+}
+
+void EffekseerEffect::finish_setup(Effekseer::EffectRef native)
+{
+	m_native = native;
+	m_loading = false;
+
+	if (m_native != nullptr) {
+		// Effekseer keeps its own copy, the data is read again if the effect is set up after release()
+		auto system = EffekseerSystem::get_instance();
+		if (system != nullptr && system->is_data_released_after_setup() && !get_path().empty()) {
+			m_data_bytes = PoolByteArray();
+		}
+
+		emit_signal("loaded");
+	} else {
+		// Lets scripts waiting for "loaded" and emitters waiting to play give up
+		emit_signal("load_failed");
 	}
 }
 
@@ -26,6 +26,16 @@ public:
 	
 	void setup();
 
+	void setup_async();
+
+	bool is_loaded() const { return m_native != nullptr; }
+
+	bool is_loading() const { return m_loading; }
+
+	Effekseer::EffectRef create_native(const Effekseer::SettingRef& setting);
+
+	void finish_setup(Effekseer::EffectRef native);
+
 	String get_data_path() const { return m_data_path; }
 
 	void set_data_path(String path) { m_data_path = path; }
@@ -34,10 +44,17 @@ public:
 
 	void set_subresources(Dictionary subresources) { m_subresources = subresources; }
 
+	Dictionary get_baked_materials() const { return m_baked_materials; }
+
+	void set_baked_materials(Dictionary baked_materials) { m_baked_materials = baked_materials; }
+
 	PoolByteArray get_data_bytes() const { return m_data_bytes; }
 
 	void set_data_bytes(PoolByteArray bytes) { m_data_bytes = bytes; }
 
+	// Returns the data, reading it again from the imported file if it was released after setup
+	PoolByteArray acquire_data();
+
 	float get_scale() const { return m_scale; }
 
 	void set_scale(float scale) { m_scale = scale; }
@@ -50,8 +67,10 @@ private:
 	String m_data_path;
 	PoolByteArray m_data_bytes;
 	Dictionary m_subresources;
+	Dictionary m_baked_materials;
 	float m_scale = 1.0f;
 	Effekseer::EffectRef m_native;
+	bool m_loading = false;
 };
 
 }
@@ -14,7 +14,7 @@ void EffekseerEmitter::_register_methods()
 	register_method("_process", &EffekseerEmitter::_process);
 	register_method("_enter_tree", &EffekseerEmitter::_enter_tree);
 	register_method("_exit_tree", &EffekseerEmitter::_exit_tree);
-	register_method("_update_draw", &EffekseerEmitter::_update_draw);
+	register_method("_notification", &EffekseerEmitter::_notification);
 	register_method("play", &EffekseerEmitter::play);
 	register_method("stop", &EffekseerEmitter::stop);
 	register_method("stop_root", &EffekseerEmitter::stop_root);
@@ -31,6 +31,28 @@ void EffekseerEmitter::_register_methods()
 		GODOT_PROPERTY_HINT_RANGE, "0.0,10.0,0.01");
 	register_property<EffekseerEmitter, Color>("color", 
 		&EffekseerEmitter::set_color, &EffekseerEmitter::get_color, Color(1.0f, 1.0f, 1.0f, 1.0f));
+	register_property<EffekseerEmitter, String>("layer", 
+		&EffekseerEmitter::set_layer, &EffekseerEmitter::get_layer, String());
+	register_property<EffekseerEmitter, float>("draw_distance", 
+		&EffekseerEmitter::set_draw_distance, &EffekseerEmitter::get_draw_distance, 0.0f,
+		GODOT_METHOD_RPC_MODE_DISABLED, GODOT_PROPERTY_USAGE_DEFAULT,
+		GODOT_PROPERTY_HINT_RANGE, "0.0,10000.0,0.1,or_greater");
+	register_property<EffekseerEmitter, float>("lod_distance", 
+		&EffekseerEmitter::set_lod_distance, &EffekseerEmitter::get_lod_distance, 0.0f,
+		GODOT_METHOD_RPC_MODE_DISABLED, GODOT_PROPERTY_USAGE_DEFAULT,
+		GODOT_PROPERTY_HINT_RANGE, "0.0,10000.0,0.1,or_greater");
+	register_property<EffekseerEmitter, Ref<EffekseerEffect>>("lod_effect", 
+		&EffekseerEmitter::set_lod_effect, &EffekseerEmitter::get_lod_effect, nullptr);
+	register_property<EffekseerEmitter, String>("lod_layer", 
+		&EffekseerEmitter::set_lod_layer, &EffekseerEmitter::get_lod_layer, String());
+	register_property<EffekseerEmitter, int>("lod_dynamic_input", 
+		&EffekseerEmitter::set_lod_dynamic_input, &EffekseerEmitter::get_lod_dynamic_input, -1,
+		GODOT_METHOD_RPC_MODE_DISABLED, GODOT_PROPERTY_USAGE_DEFAULT,
+		GODOT_PROPERTY_HINT_RANGE, "-1,3");
+	register_property<EffekseerEmitter, float>("lod_spawn_scale", 
+		&EffekseerEmitter::set_lod_spawn_scale, &EffekseerEmitter::get_lod_spawn_scale, 0.5f,
+		GODOT_METHOD_RPC_MODE_DISABLED, GODOT_PROPERTY_USAGE_DEFAULT,
+		GODOT_PROPERTY_HINT_RANGE, "0.0,1.0,0.01");
 }
 
 EffekseerEmitter::EffekseerEmitter()
@@ -54,59 +76,170 @@ void EffekseerEmitter::_ready()
 
 void EffekseerEmitter::_enter_tree()
 {
-	VisualServer::get_singleton()->connect("frame_pre_draw", this, "_update_draw");
+	// Handles are drawn by the system in the pass of this viewport
+	m_viewportIndex = EffekseerSystem::get_instance()->attach_viewport(get_viewport());
+	update_draw_layer();
+
+	// Base matrices are updated by the system when the transform changes
+	EffekseerSystem::get_instance()->register_emitter(this);
 }
 
 void EffekseerEmitter::_exit_tree()
 {
-	VisualServer::get_singleton()->disconnect("frame_pre_draw", this, "_update_draw");
+	EffekseerSystem::get_instance()->unregister_emitter(this);
+	EffekseerSystem::get_instance()->detach_viewport(m_viewportIndex);
+	m_viewportIndex = -1;
+	update_draw_layer();
 }
 
 void EffekseerEmitter::_process(float delta)
 {
 	auto system = EffekseerSystem::get_instance();
-	auto manager = system->get_manager();
+	auto manager = system->get_manager(m_layerIndex);
 
-	for (int i = 0; i < m_handles.size(); ) {
-		auto handle = m_handles[i];
-		if (!manager->Exists(handle)) {
-			m_handles.remove(i);
-			continue;
+	if (m_playPending && m_effect.is_valid() && !m_effect->is_loading()) {
+		m_playPending = false;
+		// Nothing to play if the setup has failed
+		if (m_effect->is_loaded()) {
+			play();
 		}
-		manager->SetBaseMatrix(handle, EffekseerGodot::ToEfkMatrix43(get_global_transform()));
-		i++;
 	}
+
+	EffekseerGodot::RemoveFinishedHandles(manager, m_handles);
+
+	if (m_handles.empty() || (m_drawDistance <= 0.0f && m_lodDistance <= 0.0f)) {
+		return;
+	}
+
+	const float distanceSq = get_camera_distance_sq();
+
+	// Effects beyond the draw distance from the camera are hidden
+	const float drawDistance = m_drawDistance * system->get_quality_scale();
+	const bool inDrawDistance = m_drawDistance <= 0.0f || distanceSq <= drawDistance * drawDistance;
+	if (inDrawDistance != m_inDrawDistance) {
+		m_inDrawDistance = inDrawDistance;
+		update_draw_layer();
+	}
+
+	// The effect and the layer are switched on the next play, the spawn scale immediately
+	const bool lodFar = is_lod_far(distanceSq);
+	if (lodFar != m_lodFar) {
+		m_lodFar = lodFar;
+		if (m_lodDynamicInput >= 0) {
+			for (auto handle : m_handles) {
+				manager->SetDynamicInput(handle, m_lodDynamicInput, (lodFar) ? m_lodSpawnScale : 1.0f);
+			}
+		}
+	}
+}
+
+float EffekseerEmitter::get_camera_distance_sq()
+{
+	if (!is_inside_tree()) {
+		return 0.0f;
+	}
+
+	auto camera = get_viewport()->get_camera();
+	if (camera == nullptr) {
+		return 0.0f;
+	}
+
+	return camera->get_camera_transform().origin.distance_squared_to(get_global_transform().origin);
 }
 
-void EffekseerEmitter::_update_draw()
+bool EffekseerEmitter::is_lod_far(float distanceSq) const
 {
-	if (!is_visible()) {
+	if (m_lodDistance <= 0.0f) {
+		return false;
+	}
+
+	const float lodDistance = m_lodDistance * EffekseerSystem::get_instance()->get_quality_scale();
+	return distanceSq > lodDistance * lodDistance;
+}
+
+void EffekseerEmitter::_notification(int64_t what)
+{
+	if (what == NOTIFICATION_VISIBILITY_CHANGED) {
+		update_draw_layer();
+	}
+}
+
+void EffekseerEmitter::update_transform()
+{
+	if (m_handles.empty()) {
+		return;
+	}
+
+	// Base matrices are sent only when the emitter moved since the last update
+	const Transform transform = get_global_transform();
+	if (transform == m_baseTransform) {
 		return;
 	}
+	m_baseTransform = transform;
 
-	auto viewport = get_viewport();
-	if (viewport == nullptr) return;
+	auto system = EffekseerSystem::get_instance();
+	auto manager = system->get_manager(m_layerIndex);
 
-	auto camera = viewport->get_camera();
-	if (camera == nullptr) return;
+	auto matrix = EffekseerGodot::ToEfkMatrix43(transform);
+	for (auto handle : m_handles) {
+		manager->SetBaseMatrix(handle, matrix);
+	}
+}
+
+void EffekseerEmitter::update_draw_layer()
+{
+	if (m_handles.empty()) {
+		return;
+	}
 
 	auto system = EffekseerSystem::get_instance();
-	
-	for (int i = 0; i < m_handles.size(); i++) {
-		system->draw3D(m_handles[i], camera->get_camera_transform());
+	auto manager = system->get_manager(m_layerIndex);
+
+	const int32_t drawLayer = (m_viewportIndex >= 0) ? m_viewportIndex : EffekseerSystem::DetachedDrawLayer;
+	const bool shown = is_inside_tree() && is_visible_in_tree() && m_inDrawDistance;
+
+	for (auto handle : m_handles) {
+		manager->SetLayer(handle, drawLayer);
+		manager->SetShown(handle, shown);
 	}
 }
 
 void EffekseerEmitter::play()
 {
 	auto system = EffekseerSystem::get_instance();
-	auto manager = system->get_manager();
 
-	if (m_effect.is_valid()) {
-		Effekseer::Handle handle = manager->Play(m_effect->get_native(), Effekseer::Vector3D(0, 0, 0));
+	const bool lodFar = is_lod_far(get_camera_distance_sq());
+	const Ref<EffekseerEffect>& effect = (lodFar && m_lodEffect.is_valid()) ? m_lodEffect : m_effect;
+
+	// Played once the effect finishes setup_async()
+	if (effect.is_valid() && effect->is_loading()) {
+		m_playPending = true;
+		return;
+	}
+
+	// Handles are kept in one layer, set_layer() stops them before switching
+	if (m_handles.empty()) {
+		const String& layer = (lodFar && !m_lodLayer.empty()) ? m_lodLayer : m_layer;
+		m_layerIndex = system->find_layer(layer);
+		if (m_layerIndex < 0) {
+			Godot::print_error(String("Unknown effect layer: ") + layer, __FUNCTION__, "", __LINE__);
+			m_layerIndex = 0;
+		}
+	}
+	auto manager = system->get_manager(m_layerIndex);
+
+	if (effect.is_valid() && effect->is_loaded()) {
+		Effekseer::Handle handle = manager->Play(effect->get_native(), Effekseer::Vector3D(0, 0, 0));
 		if (handle >= 0) {
-			manager->SetBaseMatrix(handle, EffekseerGodot::ToEfkMatrix43(get_global_transform()));
+			// The first handle starts the cache of the base matrix, later ones are caught up by the next update
+			const Transform transform = get_global_transform();
+			if (m_handles.empty()) {
+				m_baseTransform = transform;
+			}
+			manager->SetBaseMatrix(handle, EffekseerGodot::ToEfkMatrix43(transform));
 			manager->SetUserData(handle, this);
+			manager->SetLayer(handle, (m_viewportIndex >= 0) ? m_viewportIndex : EffekseerSystem::DetachedDrawLayer);
+			manager->SetShown(handle, is_inside_tree() && is_visible_in_tree() && m_inDrawDistance);
 
 			if (m_paused) {
 				manager->SetPaused(handle, true);
@@ -117,6 +250,9 @@ void EffekseerEmitter::play()
 			if (m_color != Effekseer::Color(255, 255, 255, 255)) {
 				manager->SetAllColor(handle, m_color);
 			}
+			if (m_lodDynamicInput >= 0) {
+				manager->SetDynamicInput(handle, m_lodDynamicInput, (lodFar) ? m_lodSpawnScale : 1.0f);
+			}
 			m_handles.push_back(handle);
 		}
 	}
@@ -125,28 +261,29 @@ void EffekseerEmitter::play()
 void EffekseerEmitter::stop()
 {
 	auto system = EffekseerSystem::get_instance();
-	auto manager = system->get_manager();
+	auto manager = system->get_manager(m_layerIndex);
 
-	for (int i = 0; i < m_handles.size(); i++) {
-		manager->StopEffect(m_handles[i]);
+	for (auto handle : m_handles) {
+		manager->StopEffect(handle);
 	}
 	
 	m_handles.clear();
+	m_playPending = false;
 }
 
 void EffekseerEmitter::stop_root()
 {
 	auto system = EffekseerSystem::get_instance();
-	auto manager = system->get_manager();
+	auto manager = system->get_manager(m_layerIndex);
 
-	for (int i = 0; i < m_handles.size(); i++) {
-		manager->StopRoot(m_handles[i]);
+	for (auto handle : m_handles) {
+		manager->StopRoot(handle);
 	}
 }
 
 bool EffekseerEmitter::is_playing()
 {
-	return !m_handles.empty();
+	return !m_handles.empty() || m_playPending;
 }
 
 void EffekseerEmitter::set_paused(bool paused)
@@ -154,10 +291,10 @@ void EffekseerEmitter::set_paused(bool paused)
 	m_paused = paused;
 
 	auto system = EffekseerSystem::get_instance();
-	auto manager = system->get_manager();
+	auto manager = system->get_manager(m_layerIndex);
 
-	for (int i = 0; i < m_handles.size(); i++) {
-		manager->SetPaused(m_handles[i], paused);
+	for (auto handle : m_handles) {
+		manager->SetPaused(handle, paused);
 	}
 }
 
@@ -171,10 +308,10 @@ void EffekseerEmitter::set_speed(float speed)
 	m_speed = speed;
 
 	auto system = EffekseerSystem::get_instance();
-	auto manager = system->get_manager();
+	auto manager = system->get_manager(m_layerIndex);
 
-	for (int i = 0; i < m_handles.size(); i++) {
-		manager->SetSpeed(m_handles[i], speed);
+	for (auto handle : m_handles) {
+		manager->SetSpeed(handle, speed);
 	}
 }
 
@@ -188,10 +325,10 @@ void EffekseerEmitter::set_color(Color color)
 	m_color = EffekseerGodot::ToEfkColor(color);
 
 	auto system = EffekseerSystem::get_instance();
-	auto manager = system->get_manager();
+	auto manager = system->get_manager(m_layerIndex);
 
-	for (int i = 0; i < m_handles.size(); i++) {
-		manager->SetAllColor(m_handles[i], m_color);
+	for (auto handle : m_handles) {
+		manager->SetAllColor(handle, m_color);
 	}
 }
 
@@ -200,10 +337,39 @@ Color EffekseerEmitter::get_color() const
 	return EffekseerGodot::ToGdColor(m_color);
 }
 
+void EffekseerEmitter::set_layer(String layer)
+{
+	if (!m_handles.empty()) {
+		stop();
+	}
+	m_layer = layer;
+}
+
+void EffekseerEmitter::set_draw_distance(float distance)
+{
+	m_drawDistance = std::max(0.0f, distance);
+
+	// Shown again until the next distance test
+	if (!m_inDrawDistance) {
+		m_inDrawDistance = true;
+		update_draw_layer();
+	}
+}
+
+void EffekseerEmitter::set_lod_effect(Ref<EffekseerEffect> effect)
+{
+	m_lodEffect = effect;
+	if (auto system = EffekseerSystem::get_instance()) {
+		system->setup_effect(m_lodEffect);
+	}
+}
+
 void EffekseerEmitter::set_effect(Ref<EffekseerEffect> effect)
 {
 	m_effect = effect;
-	m_effect->setup();
+	if (auto system = EffekseerSystem::get_instance()) {
+		system->setup_effect(m_effect);
+	}
 }
 
 }
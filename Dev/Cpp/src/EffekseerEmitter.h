@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+#include <vector>
 #include <Godot.hpp>
 #include <Spatial.hpp>
 #include "EffekseerEffect.h"
@@ -27,7 +29,9 @@ public:
 
 	void _process(float delta);
 
-	void _update_draw();
+	void _notification(int64_t what);
+
+	void update_transform();
 
 	void play();
 
@@ -49,6 +53,34 @@ public:
 
 	Color get_color() const;
 
+	void set_layer(String layer);
+
+	String get_layer() const { return m_layer; }
+
+	void set_draw_distance(float distance);
+
+	float get_draw_distance() const { return m_drawDistance; }
+
+	void set_lod_distance(float distance) { m_lodDistance = std::max(0.0f, distance); }
+
+	float get_lod_distance() const { return m_lodDistance; }
+
+	void set_lod_effect(Ref<EffekseerEffect> effect);
+
+	Ref<EffekseerEffect> get_lod_effect() const { return m_lodEffect; }
+
+	void set_lod_layer(String layer) { m_lodLayer = layer; }
+
+	String get_lod_layer() const { return m_lodLayer; }
+
+	void set_lod_dynamic_input(int index) { m_lodDynamicInput = index; }
+
+	int get_lod_dynamic_input() const { return m_lodDynamicInput; }
+
+	void set_lod_spawn_scale(float scale) { m_lodSpawnScale = scale; }
+
+	float get_lod_spawn_scale() const { return m_lodSpawnScale; }
+
 	void set_effect(Ref<EffekseerEffect> effect);
 
 	Ref<EffekseerEffect> get_effect() const { return m_effect; }
@@ -58,12 +90,37 @@ public:
 	bool is_autoplay() const { return m_autoplay; }
 
 private:
+	void update_draw_layer();
+
+	float get_camera_distance_sq();
+
+	bool is_lod_far(float distanceSq) const;
+
 	Ref<EffekseerEffect> m_effect;
 	bool m_autoplay = true;
-	Array m_handles;
+	std::vector<Effekseer::Handle> m_handles;
 	bool m_paused = false;
+	bool m_playPending = false;
 	float m_speed = 1.0f;
 	Effekseer::Color m_color = {255, 255, 255, 255};
+	String m_layer;
+	int m_layerIndex = 0;
+	int m_viewportIndex = -1;
+	float m_drawDistance = 0.0f;
+	bool m_inDrawDistance = true;
+
+	// Far emitters play a cheaper effect on a slower layer and scale their spawn counts
+	float m_lodDistance = 0.0f;
+	Ref<EffekseerEffect> m_lodEffect;
+	String m_lodLayer;
+	int m_lodDynamicInput = -1;
+	float m_lodSpawnScale = 0.5f;
+	bool m_lodFar = false;
+
+	// Position in the transform list of the system, and the transform last sent as base matrix
+	int m_transformIndex = -1;
+	Transform m_baseTransform;
+	friend class EffekseerSystem;
 };
 
 }
@@ -14,7 +14,6 @@ void EffekseerEmitter2D::_register_methods()
 	register_method("_process", &EffekseerEmitter2D::_process);
 	register_method("_enter_tree", &EffekseerEmitter2D::_enter_tree);
 	register_method("_exit_tree", &EffekseerEmitter2D::_exit_tree);
-	register_method("_update_draw", &EffekseerEmitter2D::_update_draw);
 	register_method("play", &EffekseerEmitter2D::play);
 	register_method("stop", &EffekseerEmitter2D::stop);
 	register_method("stop_root", &EffekseerEmitter2D::stop_root);
@@ -31,6 +30,8 @@ void EffekseerEmitter2D::_register_methods()
 		GODOT_PROPERTY_HINT_RANGE, "0.0,10.0,0.01");
 	register_property<EffekseerEmitter2D, Color>("color", 
 		&EffekseerEmitter2D::set_color, &EffekseerEmitter2D::get_color, Color(1.0f, 1.0f, 1.0f, 1.0f));
+	register_property<EffekseerEmitter2D, String>("layer", 
+		&EffekseerEmitter2D::set_layer, &EffekseerEmitter2D::get_layer, String());
 	register_property<EffekseerEmitter2D, Vector3>("orientation", 
 		&EffekseerEmitter2D::set_orientation, &EffekseerEmitter2D::get_orientation, {});
 }
@@ -56,30 +57,31 @@ void EffekseerEmitter2D::_ready()
 
 void EffekseerEmitter2D::_enter_tree()
 {
-	VisualServer::get_singleton()->connect("frame_pre_draw", this, "_update_draw");
+	EffekseerSystem::get_instance()->register_emitter(this);
 }
 
 void EffekseerEmitter2D::_exit_tree()
 {
-	VisualServer::get_singleton()->disconnect("frame_pre_draw", this, "_update_draw");
+	EffekseerSystem::get_instance()->unregister_emitter(this);
 }
 
 void EffekseerEmitter2D::_process(float delta)
 {
 	auto system = EffekseerSystem::get_instance();
-	auto manager = system->get_manager();
+	auto manager = system->get_manager_2d(m_layerIndex);
 
-	for (int i = 0; i < m_handles.size(); ) {
-		auto handle = m_handles[i];
-		if (!manager->Exists(handle)) {
-			m_handles.remove(i);
-			continue;
+	if (m_playPending && m_effect.is_valid() && !m_effect->is_loading()) {
+		m_playPending = false;
+		// Nothing to play if the setup has failed
+		if (m_effect->is_loaded()) {
+			play();
 		}
-		i++;
 	}
+
+	EffekseerGodot::RemoveFinishedHandles(manager, m_handles);
 }
 
-void EffekseerEmitter2D::_update_draw()
+void EffekseerEmitter2D::update_draw()
 {
 	if (!is_visible()) {
 		return;
@@ -92,22 +94,36 @@ void EffekseerEmitter2D::_update_draw()
 
 	VisualServer::get_singleton()->canvas_item_clear(get_canvas_item());
 
-	for (int i = 0; i < m_handles.size(); i++) {
-		system->draw2D(m_handles[i], viewport->get_canvas_transform());
-	}
+	system->draw2D(m_layerIndex, m_handles, viewport->get_canvas_transform());
 }
 
 void EffekseerEmitter2D::play()
 {
 	auto system = EffekseerSystem::get_instance();
-	auto manager = system->get_manager();
 
-	if (m_effect.is_valid()) {
+	// Played once the effect finishes setup_async()
+	if (m_effect.is_valid() && m_effect->is_loading()) {
+		m_playPending = true;
+		return;
+	}
+
+	// Handles are kept in one layer, set_layer() stops them before switching
+	if (m_handles.empty()) {
+		m_layerIndex = system->find_layer(m_layer);
+		if (m_layerIndex < 0) {
+			Godot::print_error(String("Unknown effect layer: ") + m_layer, __FUNCTION__, "", __LINE__);
+			m_layerIndex = 0;
+		}
+	}
+	auto manager = system->get_manager_2d(m_layerIndex);
+
+	if (m_effect.is_valid() && m_effect->is_loaded()) {
 		Effekseer::Handle handle = manager->Play(m_effect->get_native(), Effekseer::Vector3D(0, 0, 0));
 		if (handle >= 0) {
 			Vector3 rotation = m_orientation * (3.141592f / 180.0f);
 			manager->SetRotation(handle, rotation.x, rotation.y, rotation.z);
 			manager->SetUserData(handle, this);
+			manager->SetLayer(handle, EffekseerSystem::DetachedDrawLayer);
 
 			if (m_paused) {
 				manager->SetPaused(handle, true);
@@ -126,28 +142,29 @@ void EffekseerEmitter2D::play()
 void EffekseerEmitter2D::stop()
 {
 	auto system = EffekseerSystem::get_instance();
-	auto manager = system->get_manager();
+	auto manager = system->get_manager_2d(m_layerIndex);
 
-	for (int i = 0; i < m_handles.size(); i++) {
-		manager->StopEffect(m_handles[i]);
+	for (auto handle : m_handles) {
+		manager->StopEffect(handle);
 	}
 	
 	m_handles.clear();
+	m_playPending = false;
 }
 
 void EffekseerEmitter2D::stop_root()
 {
 	auto system = EffekseerSystem::get_instance();
-	auto manager = system->get_manager();
+	auto manager = system->get_manager_2d(m_layerIndex);
 
-	for (int i = 0; i < m_handles.size(); i++) {
-		manager->StopRoot(m_handles[i]);
+	for (auto handle : m_handles) {
+		manager->StopRoot(handle);
 	}
 }
 
 bool EffekseerEmitter2D::is_playing()
 {
-	return !m_handles.empty();
+	return !m_handles.empty() || m_playPending;
 }
 
 void EffekseerEmitter2D::set_paused(bool paused)
@@ -155,10 +172,10 @@ void EffekseerEmitter2D::set_paused(bool paused)
 	m_paused = paused;
 
 	auto system = EffekseerSystem::get_instance();
-	auto manager = system->get_manager();
+	auto manager = system->get_manager_2d(m_layerIndex);
 
-	for (int i = 0; i < m_handles.size(); i++) {
-		manager->SetPaused(m_handles[i], paused);
+	for (auto handle : m_handles) {
+		manager->SetPaused(handle, paused);
 	}
 }
 
@@ -172,10 +189,10 @@ void EffekseerEmitter2D::set_speed(float speed)
 	m_speed = speed;
 
 	auto system = EffekseerSystem::get_instance();
-	auto manager = system->get_manager();
+	auto manager = system->get_manager_2d(m_layerIndex);
 
-	for (int i = 0; i < m_handles.size(); i++) {
-		manager->SetSpeed(m_handles[i], speed);
+	for (auto handle : m_handles) {
+		manager->SetSpeed(handle, speed);
 	}
 }
 
@@ -189,10 +206,10 @@ void EffekseerEmitter2D::set_color(Color color)
 	m_color = EffekseerGodot::ToEfkColor(color);
 
 	auto system = EffekseerSystem::get_instance();
-	auto manager = system->get_manager();
+	auto manager = system->get_manager_2d(m_layerIndex);
 
-	for (int i = 0; i < m_handles.size(); i++) {
-		manager->SetAllColor(m_handles[i], m_color);
+	for (auto handle : m_handles) {
+		manager->SetAllColor(handle, m_color);
 	}
 }
 
@@ -206,11 +223,11 @@ void EffekseerEmitter2D::set_orientation(Vector3 orientation)
 	m_orientation = orientation;
 
 	auto system = EffekseerSystem::get_instance();
-	auto manager = system->get_manager();
+	auto manager = system->get_manager_2d(m_layerIndex);
 
 	Vector3 rotation = m_orientation * (3.141592f * 2.0f);
-	for (int i = 0; i < m_handles.size(); i++) {
-		manager->SetRotation(m_handles[i], rotation.x, rotation.y, rotation.z);
+	for (auto handle : m_handles) {
+		manager->SetRotation(handle, rotation.x, rotation.y, rotation.z);
 	}
 }
 
@@ -219,10 +236,20 @@ Vector3 EffekseerEmitter2D::get_orientation() const
 	return m_orientation;
 }
 
+void EffekseerEmitter2D::set_layer(String layer)
+{
+	if (!m_handles.empty()) {
+		stop();
+	}
+	m_layer = layer;
+}
+
 void EffekseerEmitter2D::set_effect(Ref<EffekseerEffect> effect)
 {
 	m_effect = effect;
-	m_effect->setup();
+	if (auto system = EffekseerSystem::get_instance()) {
+		system->setup_effect(m_effect);
+	}
 }
 
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <vector>
 #include <Godot.hpp>
 #include <Node2D.hpp>
 #include "EffekseerEffect.h"
@@ -27,7 +28,7 @@ public:
 
 	void _process(float delta);
 
-	void _update_draw();
+	void update_draw();
 
 	void play();
 
@@ -53,6 +54,10 @@ public:
 
 	Vector3 get_orientation() const;
 
+	void set_layer(String layer);
+
+	String get_layer() const { return m_layer; }
+
 	void set_effect(Ref<EffekseerEffect> effect);
 
 	Ref<EffekseerEffect> get_effect() const { return m_effect; }
@@ -64,11 +69,18 @@ public:
 private:
 	Ref<EffekseerEffect> m_effect;
 	bool m_autoplay = true;
-	Array m_handles;
+	std::vector<Effekseer::Handle> m_handles;
 	bool m_paused = false;
+	bool m_playPending = false;
 	float m_speed = 1.0f;
 	Effekseer::Color m_color = {255, 255, 255, 255};
+	String m_layer;
+	int m_layerIndex = 0;
 	Vector3 m_orientation;
+
+	// Position in the draw list of the system
+	int m_drawIndex = -1;
+	friend class EffekseerSystem;
 };
 
 }
@@ -1,4 +1,5 @@
 #include <File.hpp>
+#include <ResourceLoader.hpp>
 #include "EffekseerSystem.h"
 #include "EffekseerResource.h"
 
@@ -36,4 +37,29 @@ void EffekseerResource::load(String path)
 	file->close();
 }
 
+PoolByteArray EffekseerResource::acquire_data()
+{
+	std::lock_guard<std::mutex> lock(m_dataMutex);
+
+	if (m_data_bytes.size() == 0 && !get_path().empty()) {
+		// Bypasses the cache, which would return this resource itself
+		Ref<Resource> resource = ResourceLoader::get_singleton()->load(get_path(), "", true);
+		if (auto reloaded = resource.is_valid() ? as<EffekseerResource>(resource.ptr()) : nullptr) {
+			m_data_bytes = reloaded->get_data_bytes();
+		}
+	}
+	return m_data_bytes;
+}
+
+void EffekseerResource::release_data()
+{
+	auto system = EffekseerSystem::get_instance();
+	if (system == nullptr || !system->is_data_released_after_setup() || get_path().empty()) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_dataMutex);
+	m_data_bytes = PoolByteArray();
+}
+
 }
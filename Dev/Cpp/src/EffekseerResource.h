@@ -1,5 +1,6 @@
 #pragma once
 
+#include <mutex>
 #include <Godot.hpp>
 #include <Resource.hpp>
 #include <Effekseer.h>
@@ -22,12 +23,19 @@ public:
 
 	const PoolByteArray& get_data_ref() const { return m_data_bytes; }
 
+	// Returns the data, reading it again from the imported file if it was released
+	PoolByteArray acquire_data();
+
+	// Releases the data once a loader has built its own copy, if enabled in the project settings
+	void release_data();
+
 	PoolByteArray get_data_bytes() const { return m_data_bytes; }
 
 	void set_data_bytes(PoolByteArray bytes) { m_data_bytes = bytes; }
 
 private:
 	PoolByteArray m_data_bytes;
+	std::mutex m_dataMutex;
 };
 
 }
@@ -1,12 +1,19 @@
 #include <ProjectSettings.hpp>
+#include <Engine.hpp>
 #include <ResourceLoader.hpp>
 #include <Viewport.hpp>
 #include <Camera.hpp>
 #include <Transform.hpp>
 #include <GDScript.hpp>
 #include <VisualServer.hpp>
+#include <File.hpp>
+#include <OS.hpp>
+#include <algorithm>
+#include <cmath>
 
 #include "RendererGodot/EffekseerGodot.Renderer.h"
+#include "RendererGodot/EffekseerGodot.Shader.h"
+#include "RendererGodot/EffekseerGodot.RenderResources.h"
 #include "LoaderGodot/EffekseerGodot.TextureLoader.h"
 #include "LoaderGodot/EffekseerGodot.ModelLoader.h"
 #include "LoaderGodot/EffekseerGodot.MaterialLoader.h"
@@ -16,6 +23,8 @@
 #include "Utils/EffekseerGodot.Utils.h"
 #include "EffekseerSystem.h"
 #include "EffekseerEffect.h"
+#include "EffekseerEmitter.h"
+#include "EffekseerEmitter2D.h"
 
 namespace godot {
 
@@ -28,9 +37,25 @@ void EffekseerSystem::_register_methods()
 	register_method("_exit_tree", &EffekseerSystem::_exit_tree);
 	register_method("_process", &EffekseerSystem::_process);
 	register_method("_update_draw", &EffekseerSystem::_update_draw);
+	register_method("_begin_async_update", &EffekseerSystem::_begin_async_update);
 	register_method("stop_all_effects", &EffekseerSystem::stop_all_effects);
 	register_method("set_paused_to_all_effects", &EffekseerSystem::set_paused_to_all_effects);
 	register_method("get_total_instance_count", &EffekseerSystem::get_total_instance_count);
+	register_method("get_render_statistics", &EffekseerSystem::get_render_statistics);
+	register_method("get_loader_statistics", &EffekseerSystem::get_loader_statistics);
+	register_method("get_shader_variants", &EffekseerSystem::get_shader_variants);
+	register_method("save_shader_variants", &EffekseerSystem::save_shader_variants);
+	register_method("set_worker_thread_count", &EffekseerSystem::set_worker_thread_count);
+	register_method("get_worker_thread_count", &EffekseerSystem::get_worker_thread_count);
+	register_method("set_layer_paused", &EffekseerSystem::set_layer_paused);
+	register_method("is_layer_paused", &EffekseerSystem::is_layer_paused);
+	register_method("set_layer_tick_rate", &EffekseerSystem::set_layer_tick_rate);
+	register_method("get_layer_tick_rate", &EffekseerSystem::get_layer_tick_rate);
+	register_method("set_quality_scale", &EffekseerSystem::set_quality_scale);
+	register_method("get_quality_scale", &EffekseerSystem::get_quality_scale);
+	register_method("preload", &EffekseerSystem::preload);
+	register_method("get_preload_progress", &EffekseerSystem::get_preload_progress);
+	register_signal<EffekseerSystem>("preload_finished", Dictionary());
 }
 
 EffekseerSystem::EffekseerSystem()
@@ -39,7 +64,14 @@ EffekseerSystem::EffekseerSystem()
 
 	int32_t instanceMaxCount = 2000;
 	int32_t squareMaxCount = 8000;
-	int32_t drawMaxCount = 128;
+	int32_t drawMaxCount = 1024;
+	int32_t workerThreadCount = -1;
+	float updateTickRate = 60.0f;
+	PoolStringArray layers;
+	auto uploadMode = EffekseerGodot::GeometryUploadMode::Mesh;
+	auto overflowPolicy = EffekseerGodot::DrawOverflowPolicy::DropLowestPriority;
+	auto vertexTextureFormat = EffekseerGodot::VertexTextureFormat::RGBAF;
+	String shaderPrewarmList;
 	Ref<Script> soundScript;
 
 	auto settings = ProjectSettings::get_singleton();
@@ -53,6 +85,53 @@ EffekseerSystem::EffekseerSystem()
 	if (settings->has_setting("effekseer/draw_max_count")) {
 		drawMaxCount = (int32_t)settings->get_setting("effekseer/draw_max_count");
 	}
+	if (settings->has_setting("effekseer/geometry_upload_mode")) {
+		uploadMode = (EffekseerGodot::GeometryUploadMode)(int32_t)settings->get_setting("effekseer/geometry_upload_mode");
+	}
+	if (settings->has_setting("effekseer/draw_overflow_policy")) {
+		overflowPolicy = (EffekseerGodot::DrawOverflowPolicy)(int32_t)settings->get_setting("effekseer/draw_overflow_policy");
+	}
+	if (settings->has_setting("effekseer/vertex_texture_format")) {
+		vertexTextureFormat = (EffekseerGodot::VertexTextureFormat)(int32_t)settings->get_setting("effekseer/vertex_texture_format");
+	}
+	if (settings->has_setting("effekseer/shader_prewarm_list")) {
+		shaderPrewarmList = (String)settings->get_setting("effekseer/shader_prewarm_list");
+	}
+	if (settings->has_setting("effekseer/shader_prewarm_budget_ms")) {
+		m_shaderPrewarmBudget = (float)settings->get_setting("effekseer/shader_prewarm_budget_ms");
+	}
+	if (settings->has_setting("effekseer/update_tick_rate")) {
+		updateTickRate = (float)settings->get_setting("effekseer/update_tick_rate");
+	}
+	if (settings->has_setting("effekseer/update_max_steps")) {
+		m_updateMaxSteps = std::max(1, (int32_t)settings->get_setting("effekseer/update_max_steps"));
+	}
+	if (settings->has_setting("effekseer/update_budget_usec")) {
+		m_updateBudget = (int64_t)settings->get_setting("effekseer/update_budget_usec");
+	}
+	if (settings->has_setting("effekseer/worker_thread_count")) {
+		workerThreadCount = (int32_t)settings->get_setting("effekseer/worker_thread_count");
+	}
+	if (settings->has_setting("effekseer/layers")) {
+		layers = (PoolStringArray)settings->get_setting("effekseer/layers");
+	}
+	if (settings->has_setting("effekseer/async_update")) {
+		m_asyncUpdate = (bool)settings->get_setting("effekseer/async_update");
+	}
+	if (settings->has_setting("effekseer/async_effect_setup")) {
+		m_asyncEffectSetup = (bool)settings->get_setting("effekseer/async_effect_setup");
+	}
+	if (settings->has_setting("effekseer/effect_load_budget_ms")) {
+		m_loadBudget = (float)settings->get_setting("effekseer/effect_load_budget_ms");
+	}
+	if (settings->has_setting("effekseer/release_data_after_setup")) {
+		// The editor saves and reimports resources, they keep the data
+		m_releaseDataAfterSetup = (bool)settings->get_setting("effekseer/release_data_after_setup") && 
+			!Engine::get_singleton()->is_editor_hint();
+	}
+	if (settings->has_setting("effekseer/culling_world_size")) {
+		m_cullingWorldSize = (float)settings->get_setting("effekseer/culling_world_size");
+	}
 	if (settings->has_setting("effekseer/sound_script")) {
 		soundScript = Ref<Script>(settings->get_setting("effekseer/sound_script"));
 	} else {
@@ -60,32 +139,193 @@ EffekseerSystem::EffekseerSystem()
 	}
 	Ref<Reference> sound = EffekseerGodot::ScriptNew(soundScript);
 	
-	m_manager = Effekseer::Manager::Create(instanceMaxCount);
-#ifndef __EMSCRIPTEN__
-	m_manager->LaunchWorkerThreads(2);
+#ifdef __EMSCRIPTEN__
+	m_asyncUpdate = false;
 #endif
-	m_manager->SetTextureLoader(Effekseer::MakeRefPtr<EffekseerGodot::TextureLoader>());
-	m_manager->SetModelLoader(Effekseer::MakeRefPtr<EffekseerGodot::ModelLoader>());
-	m_manager->SetMaterialLoader(Effekseer::MakeRefPtr<EffekseerGodot::MaterialLoader>());
-	m_manager->SetCurveLoader(Effekseer::MakeRefPtr<EffekseerGodot::CurveLoader>());
-	m_manager->SetSoundLoader(Effekseer::MakeRefPtr<EffekseerGodot::SoundLoader>(sound));
 
-	m_renderer = EffekseerGodot::Renderer::Create(squareMaxCount, drawMaxCount);
+	m_renderer = EffekseerGodot::Renderer::Create(squareMaxCount, drawMaxCount, 
+		uploadMode, overflowPolicy, vertexTextureFormat);
 	m_renderer->SetProjectionMatrix(Effekseer::Matrix44().Indentity());
 
-	m_manager->SetSpriteRenderer(m_renderer->CreateSpriteRenderer());
-	m_manager->SetRibbonRenderer(m_renderer->CreateRibbonRenderer());
-	m_manager->SetTrackRenderer(m_renderer->CreateTrackRenderer());
-	m_manager->SetRingRenderer(m_renderer->CreateRingRenderer());
-	m_manager->SetModelRenderer(m_renderer->CreateModelRenderer());
-	m_manager->SetSoundPlayer(Effekseer::MakeRefPtr<EffekseerGodot::SoundPlayer>(sound));
+	m_soundPlayer = Effekseer::MakeRefPtr<EffekseerGodot::SoundPlayer>(sound);
+	m_soundPlayer->SetDeferred(m_asyncUpdate);
+
+	m_warmUpInstanceMaxCount = instanceMaxCount;
+	add_layer("default", instanceMaxCount, updateTickRate);
+
+	auto manager = m_layers[0].manager;
+	manager->SetTextureLoader(Effekseer::MakeRefPtr<EffekseerGodot::TextureLoader>());
+	manager->SetModelLoader(Effekseer::MakeRefPtr<EffekseerGodot::ModelLoader>());
+	manager->SetMaterialLoader(Effekseer::MakeRefPtr<EffekseerGodot::MaterialLoader>());
+	manager->SetCurveLoader(Effekseer::MakeRefPtr<EffekseerGodot::CurveLoader>());
+	manager->SetSoundLoader(Effekseer::MakeRefPtr<EffekseerGodot::SoundLoader>(sound));
+
+	// Each entry is "name:instance_max_count:tick_rate"
+	for (int i = 0; i < layers.size(); i++) {
+		auto params = layers[i].split(":", false);
+		if (params.size() != 3 || find_layer(params[0]) >= 0) {
+			Godot::print_error(String("Invalid effect layer: ") + layers[i], __FUNCTION__, "", __LINE__);
+			continue;
+		}
+		add_layer(params[0], params[1].to_int(), params[2].to_float());
+	}
+
+	// Only the default layer is updated in parallel
+	set_worker_thread_count(workerThreadCount);
+
+	if (!shaderPrewarmList.empty()) {
+		Ref<File> file = File::_new();
+		if (file->open(shaderPrewarmList, File::READ) == Error::OK) {
+			EffekseerGodot::Shader::AddPrewarmVariants(file->get_as_text().split("\n", false));
+			m_shaderPrewarmPending = true;
+			file->close();
+		}
+	}
 }
 
 EffekseerSystem::~EffekseerSystem()
 {
+	stop_load_thread();
+	stop_update_thread();
 	s_instance = nullptr;
 }
 
+Effekseer::ManagerRef EffekseerSystem::create_manager(int32_t instanceMaxCount)
+{
+	auto manager = Effekseer::Manager::Create(std::max(1, instanceMaxCount));
+
+	// Managers share the loaders, so an effect can be played on any layer
+	if (!m_layers.empty()) {
+		manager->SetSetting(m_layers[0].manager->GetSetting());
+	}
+
+	manager->SetSpriteRenderer(m_renderer->CreateSpriteRenderer());
+	manager->SetRibbonRenderer(m_renderer->CreateRibbonRenderer());
+	manager->SetTrackRenderer(m_renderer->CreateTrackRenderer());
+	manager->SetRingRenderer(m_renderer->CreateRingRenderer());
+	manager->SetModelRenderer(m_renderer->CreateModelRenderer());
+	return manager;
+}
+
+void EffekseerSystem::add_layer(String name, int32_t instanceMaxCount, float tickRate)
+{
+	Layer layer;
+	layer.name = name;
+	layer.tickRate = std::max(1.0f, tickRate);
+	layer.instanceMaxCount = instanceMaxCount;
+	layer.manager = create_manager(instanceMaxCount);
+	layer.manager->SetSoundPlayer(m_soundPlayer);
+
+	// Effects with a culling shape are tested against the camera frustum before drawing
+	if (m_cullingWorldSize > 0.0f) {
+		layer.manager->CreateCullingWorld(m_cullingWorldSize, m_cullingWorldSize, m_cullingWorldSize, 4);
+	}
+
+	m_layers.push_back(layer);
+}
+
+const Effekseer::ManagerRef& EffekseerSystem::get_manager_2d(int layer)
+{
+	wait_update();
+	auto& target = m_layers[layer];
+
+	// Without a culling world 2D handles share the manager of the layer
+	if (m_cullingWorldSize <= 0.0f) {
+		return target.manager;
+	}
+
+	// The culled state of the culling world is calculated for the 3D cameras, 
+	// so 2D handles in canvas space are played on a manager without one
+	if (target.manager2D == nullptr) {
+		target.manager2D = create_manager(target.instanceMaxCount);
+		target.manager2D->SetSoundPlayer(m_soundPlayer);
+	}
+	return target.manager2D;
+}
+
+int EffekseerSystem::find_layer(String name) const
+{
+	if (name.empty()) {
+		return 0;
+	}
+	for (size_t i = 0; i < m_layers.size(); i++) {
+		if (m_layers[i].name == name) {
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+void EffekseerSystem::set_layer_paused(String name, bool paused)
+{
+	int layer = find_layer(name);
+	if (layer < 0) {
+		Godot::print_error(String("Unknown effect layer: ") + name, __FUNCTION__, "", __LINE__);
+		return;
+	}
+	wait_update();
+	m_layers[layer].paused = paused;
+}
+
+bool EffekseerSystem::is_layer_paused(String name) const
+{
+	int layer = find_layer(name);
+	if (layer < 0) {
+		Godot::print_error(String("Unknown effect layer: ") + name, __FUNCTION__, "", __LINE__);
+		return false;
+	}
+	return m_layers[layer].paused;
+}
+
+void EffekseerSystem::set_layer_tick_rate(String name, float tick_rate)
+{
+	int layer = find_layer(name);
+	if (layer < 0) {
+		Godot::print_error(String("Unknown effect layer: ") + name, __FUNCTION__, "", __LINE__);
+		return;
+	}
+	wait_update();
+	m_layers[layer].tickRate = std::max(1.0f, tick_rate);
+}
+
+float EffekseerSystem::get_layer_tick_rate(String name) const
+{
+	int layer = find_layer(name);
+	if (layer < 0) {
+		Godot::print_error(String("Unknown effect layer: ") + name, __FUNCTION__, "", __LINE__);
+		return 0.0f;
+	}
+	return m_layers[layer].tickRate;
+}
+
+void EffekseerSystem::set_worker_thread_count(int count)
+{
+#ifdef __EMSCRIPTEN__
+	count = 0;
+#else
+	if (count < 0) {
+		// Leave the main thread and the render thread to Godot
+		const int hardwareThreads = (int)std::thread::hardware_concurrency();
+		count = std::min(std::max(hardwareThreads - 2, 1), 8);
+	}
+#endif
+	if (count == m_workerThreadCount) {
+		return;
+	}
+
+	wait_update();
+
+	// Relaunch the threads with the new count
+	auto& manager = m_layers[0].manager;
+	if (m_workerThreadCount > 0) {
+		manager->LaunchWorkerThreads(0);
+	}
+	if (count > 0) {
+		manager->LaunchWorkerThreads((uint32_t)count);
+	}
+	m_workerThreadCount = count;
+}
+
 void EffekseerSystem::_init()
 {
 }
@@ -94,64 +334,693 @@ void EffekseerSystem::_enter_tree()
 {
 	set_process_priority(100);
 	VisualServer::get_singleton()->connect("frame_pre_draw", this, "_update_draw");
+
+	if (m_asyncUpdate) {
+		start_update_thread();
+		VisualServer::get_singleton()->connect("frame_post_draw", this, "_begin_async_update");
+	}
 }
 
 void EffekseerSystem::_exit_tree()
 {
 	VisualServer::get_singleton()->disconnect("frame_pre_draw", this, "_update_draw");
+
+	if (m_asyncUpdate) {
+		VisualServer::get_singleton()->disconnect("frame_post_draw", this, "_begin_async_update");
+		stop_update_thread();
+	}
 }
 
 void EffekseerSystem::_process(float delta)
 {
-	// Stabilize in a variable frame environment
-	float deltaFrames = delta * 60.0f;
-	int iterations = (int)roundf(deltaFrames);
-	float advance = deltaFrames / iterations;
-	for (int i = 0; i < iterations; i++) {
-		m_manager->Update(advance);
+	if (m_shaderPrewarmPending) {
+		int64_t budget = (int64_t)(m_shaderPrewarmBudget * 1000.0f);
+		m_shaderPrewarmPending = EffekseerGodot::Shader::PrewarmVariants(budget) > 0;
+	}
+
+	wait_update();
+
+	update_effect_loads();
+	update_preloads();
+	update_transforms();
+
+	// Stabilize in a variable frame environment by updating in fixed ticks
+	for (auto& layer : m_layers) {
+		if (layer.paused) {
+			continue;
+		}
+		layer.accumulator += delta * layer.tickRate;
+		int32_t steps = (int32_t)layer.accumulator;
+		layer.accumulator -= (float)steps;
+		layer.pendingSteps += steps;
+	}
+
+	if (m_asyncUpdate) {
+		// Runs after this frame is drawn
+		m_asyncUpdatePending = true;
+	} else {
+		update_layers();
 	}
 	m_renderer->SetTime(m_renderer->GetTime() + delta);
 }
 
+void EffekseerSystem::update_layers()
+{
+	// The update budget is shared by all the layers of a frame
+	const int64_t startTime = (m_updateBudget > 0) ? OS::get_singleton()->get_ticks_usec() : 0;
+	for (auto& layer : m_layers) {
+		update_manager(layer, layer.pendingSteps, startTime);
+		layer.pendingSteps = 0;
+	}
+}
+
+void EffekseerSystem::update_manager(Layer& layer, int32_t steps, int64_t startTime)
+{
+	auto update = [&layer](float deltaFrame) {
+		layer.manager->Update(deltaFrame);
+		if (layer.manager2D != nullptr) {
+			layer.manager2D->Update(deltaFrame);
+		}
+	};
+
+	// Effekseer counts time in 60fps frames
+	const float advance = 60.0f / layer.tickRate;
+	for (int32_t i = 0; i < steps; i++) {
+		// Steps beyond the limits are folded into one larger update
+		const bool lastStep = i + 1 >= m_updateMaxSteps || 
+			(m_updateBudget > 0 && OS::get_singleton()->get_ticks_usec() - startTime >= m_updateBudget);
+		if (lastStep) {
+			update(advance * (steps - i));
+			break;
+		}
+		update(advance);
+	}
+}
+
+void EffekseerSystem::_begin_async_update()
+{
+	if (!m_asyncUpdatePending) {
+		return;
+	}
+	m_asyncUpdatePending = false;
+
+	std::lock_guard<std::mutex> lock(m_updateMutex);
+	m_updateRequested = true;
+	m_updateCondition.notify_all();
+}
+
+void EffekseerSystem::wait_update() const
+{
+	if (!m_updateThread.joinable()) {
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(m_updateMutex);
+	m_updateCondition.wait(lock, [this]() { return !m_updateRequested; });
+	lock.unlock();
+
+	// Sounds are started on the main thread once the update is done
+	m_soundPlayer->Flush();
+}
+
+void EffekseerSystem::start_update_thread()
+{
+	if (m_updateThread.joinable()) {
+		return;
+	}
+
+	m_updateThreadExit = false;
+	m_updateThread = std::thread([this]() {
+		std::unique_lock<std::mutex> lock(m_updateMutex);
+		while (true) {
+			m_updateCondition.wait(lock, [this]() { return m_updateRequested || m_updateThreadExit; });
+			if (m_updateThreadExit) {
+				break;
+			}
+
+			lock.unlock();
+			update_layers();
+			lock.lock();
+
+			m_updateRequested = false;
+			m_updateCondition.notify_all();
+		}
+	});
+}
+
+void EffekseerSystem::stop_update_thread()
+{
+	if (!m_updateThread.joinable()) {
+		return;
+	}
+
+	wait_update();
+	{
+		std::lock_guard<std::mutex> lock(m_updateMutex);
+		m_updateThreadExit = true;
+		m_updateCondition.notify_all();
+	}
+	m_updateThread.join();
+}
+
+void EffekseerSystem::load_effect_async(Ref<EffekseerEffect> effect)
+{
+	start_load_thread();
+
+	std::lock_guard<std::mutex> lock(m_loadMutex);
+	m_loadRequests.push_back(effect);
+	m_loadCondition.notify_all();
+}
+
+void EffekseerSystem::setup_effect(Ref<EffekseerEffect> effect)
+{
+	if (effect.is_null()) {
+		return;
+	}
+
+	if (m_asyncEffectSetup) {
+		effect->setup_async();
+	} else {
+		effect->setup();
+	}
+}
+
+void EffekseerSystem::preload(Array effects, float budget_ms, bool warm_up)
+{
+	for (int i = 0; i < effects.size(); i++) {
+		Ref<EffekseerEffect> effect = effects[i];
+		if (effect.is_null()) {
+			continue;
+		}
+
+		// Effects already set up are kept too, they may still be warmed up
+		EffectPreload entry;
+		entry.effect = effect;
+		entry.warmUp = warm_up;
+
+		// The load thread works through all of them while the main thread waits
+		if (m_asyncEffectSetup && !effect->is_loaded()) {
+			setup_effect(effect);
+		}
+		entry.setupRequested = effect->is_loading();
+
+		m_preloads.push_back(entry);
+		m_preloadCount++;
+	}
+	m_preloadBudget = std::max(0.0f, budget_ms);
+
+	// preload_finished is always emitted from _process, even for an empty request
+	m_preloadFinishPending = true;
+}
+
+float EffekseerSystem::get_preload_progress() const
+{
+	if (m_preloadCount == 0) {
+		return 1.0f;
+	}
+	return 1.0f - (float)m_preloads.size() / (float)m_preloadCount;
+}
+
+void EffekseerSystem::update_preloads()
+{
+	// Warm-up handles live for a single drawn frame, the update removes the stopped ones
+	if (m_warmUpHandles.size() > 0) {
+		for (auto handle : m_warmUpHandles) {
+			m_warmUpManager->StopEffect(handle);
+		}
+		m_warmUpManager->Update(0.0f);
+		m_warmUpHandles.clear();
+		m_warmUpWorld.unref();
+	}
+
+	if (m_preloads.empty()) {
+		if (m_preloadFinishPending) {
+			finish_preload();
+		}
+		return;
+	}
+
+	auto os = OS::get_singleton();
+	const int64_t startTime = os->get_ticks_usec();
+	const int64_t budget = (int64_t)(m_preloadBudget * 1000.0f);
+
+	// Warm-up effects are played transparently in front of the first camera
+	Camera* camera = nullptr;
+	for (auto& drawViewport : m_viewports) {
+		if (drawViewport.viewport != nullptr && (camera = drawViewport.viewport->get_camera()) != nullptr) {
+			break;
+		}
+	}
+
+	size_t count = 0;
+	for (size_t i = 0; i < m_preloads.size(); i++) {
+		auto& entry = m_preloads[i];
+		bool completed = false;
+
+		// Out of budget, the rest are kept for the next frame
+		if (os->get_ticks_usec() - startTime < budget) {
+			if (!entry.setupRequested && !entry.effect->is_loaded() && !entry.effect->is_loading()) {
+				setup_effect(entry.effect);
+				entry.setupRequested = true;
+			}
+
+			if (!entry.effect->is_loaded()) {
+				// Setup is tried once, an effect which failed to load (load_failed) is given up
+				completed = entry.setupRequested && !entry.effect->is_loading();
+			} else {
+				// Without a camera there is nothing to warm up with, only the setup is done
+				if (entry.warmUp && camera != nullptr) {
+					warm_up_effect(entry.effect, camera);
+				}
+				completed = true;
+			}
+		}
+
+		if (!completed) {
+			m_preloads[count++] = entry;
+		}
+	}
+	m_preloads.resize(count);
+
+	// Prewarm list variants of the shaders loaded above are compiled within the same budget
+	const int64_t remaining = budget - (os->get_ticks_usec() - startTime);
+	if (m_shaderPrewarmPending && remaining > 0) {
+		m_shaderPrewarmPending = EffekseerGodot::Shader::PrewarmVariants(remaining) > 0;
+	}
+
+	// With warm-up handles it is emitted after they are drawn, on the next frame
+	if (m_preloadFinishPending && m_preloads.empty() && m_warmUpHandles.empty()) {
+		finish_preload();
+	}
+}
+
+void EffekseerSystem::warm_up_effect(Ref<EffekseerEffect> effect, Camera* camera)
+{
+	// Warm-up plays have their own manager, without a sound player and apart from the instance pools of the layers
+	if (m_warmUpManager == nullptr) {
+		m_warmUpManager = create_manager(m_warmUpInstanceMaxCount);
+	}
+
+	auto transform = camera->get_camera_transform();
+	auto position = transform.origin - transform.basis.z * (camera->get_znear() + 1.0f);
+
+	// The pool is full, the effect is only set up
+	auto handle = m_warmUpManager->Play(effect->get_native(), position.x, position.y, position.z);
+	if (handle < 0) {
+		return;
+	}
+
+	// The renderer draws the handle in the world given as user data, it is held until the handle is stopped
+	m_warmUpWorld = camera->get_world();
+	m_warmUpManager->SetUserData(handle, m_warmUpWorld.ptr());
+	m_warmUpManager->SetLayer(handle, WarmUpDrawLayer);
+	m_warmUpManager->SetAllColor(handle, Effekseer::Color(255, 255, 255, 0));
+	m_warmUpManager->UpdateHandle(handle, 1.0f);
+	m_warmUpHandles.push_back(handle);
+}
+
+void EffekseerSystem::finish_preload()
+{
+	m_preloadFinishPending = false;
+	m_preloadCount = 0;
+	m_warmUpManager.Reset();
+	emit_signal("preload_finished");
+}
+
+void EffekseerSystem::update_effect_loads()
+{
+	auto os = OS::get_singleton();
+	const int64_t startTime = os->get_ticks_usec();
+	const int64_t budget = (int64_t)(m_loadBudget * 1000.0f);
+
+	std::unique_lock<std::mutex> lock(m_loadMutex);
+	while (!m_loadResults.empty() && os->get_ticks_usec() - startTime < budget) {
+		auto& load = m_loadResults.front();
+		lock.unlock();
+
+		// Model meshes are created on the main thread, a few per frame
+		bool completed = true;
+		if (load.native != nullptr) {
+			while (load.modelIndex < load.native->GetModelCount()) {
+				auto model = load.native->GetModel(load.modelIndex++).DownCast<EffekseerGodot::Model>();
+				if (model != nullptr && model->CreateMesh() && os->get_ticks_usec() - startTime >= budget) {
+					completed = load.modelIndex >= load.native->GetModelCount();
+					break;
+				}
+			}
+		}
+
+		if (completed) {
+			auto effect = load.effect;
+			auto native = load.native;
+			lock.lock();
+			m_loadResults.pop_front();
+			lock.unlock();
+			effect->finish_setup(native);
+		}
+		lock.lock();
+	}
+}
+
+void EffekseerSystem::start_load_thread()
+{
+	if (m_loadThread.joinable()) {
+		return;
+	}
+
+	// Effects are created with the shared loaders of the default layer
+	auto setting = m_layers[0].manager->GetSetting();
+
+	m_loadThreadExit = false;
+	m_loadThread = std::thread([this, setting]() {
+		std::unique_lock<std::mutex> lock(m_loadMutex);
+		while (true) {
+			m_loadCondition.wait(lock, [this]() { return !m_loadRequests.empty() || m_loadThreadExit; });
+			if (m_loadThreadExit) {
+				break;
+			}
+
+			EffectLoad load;
+			load.effect = m_loadRequests.front();
+			m_loadRequests.pop_front();
+
+			lock.unlock();
+			load.native = load.effect->create_native(setting);
+			lock.lock();
+
+			m_loadResults.push_back(load);
+		}
+	});
+}
+
+void EffekseerSystem::stop_load_thread()
+{
+	if (!m_loadThread.joinable()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_loadMutex);
+		m_loadThreadExit = true;
+		m_loadCondition.notify_all();
+	}
+	m_loadThread.join();
+
+	m_loadRequests.clear();
+	m_loadResults.clear();
+}
+
 void EffekseerSystem::_update_draw()
 {
+	wait_update();
 	m_renderer->ResetState();
+
+	draw_viewports();
+
+	// 2D emitters are walked here instead of connecting each of them to frame_pre_draw
+	for (size_t i = 0; i < m_emitters2D.size(); i++) {
+		m_emitters2D[i]->update_draw();
+	}
+
+	m_renderer->FlushVertexTextures();
 }
 
-void EffekseerSystem::draw3D(Effekseer::Handle handle, const Transform& camera_transform)
+static Effekseer::Matrix44 GetCameraProjection(Camera* camera, Viewport* viewport)
 {
-	Effekseer:: Matrix44 matrix = EffekseerGodot::ToEfkMatrix44(camera_transform.inverse());
-	m_renderer->SetCameraMatrix(matrix);
+	const Vector2 size = viewport->get_visible_rect().size;
+	const float aspect = (size.y > 0.0f) ? size.x / size.y : 1.0f;
+	const bool keepWidth = camera->get_keep_aspect_mode() == Camera::KEEP_WIDTH;
 
-	m_renderer->BeginRendering();
-	m_manager->DrawHandle(handle);
-	m_renderer->EndRendering();
+	Effekseer::Matrix44 projection;
+	if (camera->get_projection() == Camera::PROJECTION_ORTHOGONAL) {
+		const float height = (keepWidth) ? camera->get_size() / aspect : camera->get_size();
+		projection.OrthographicRH(height * aspect, height, camera->get_znear(), camera->get_zfar());
+	} else {
+		// Frustum cameras are approximated with their field of view
+		float fovY = camera->get_fov() * (3.141592f / 180.0f);
+		if (keepWidth) {
+			fovY = 2.0f * atanf(tanf(fovY * 0.5f) / aspect);
+		}
+		projection.PerspectiveFovRH(fovY, aspect, camera->get_znear(), camera->get_zfar());
+	}
+	return projection;
+}
+
+void EffekseerSystem::draw_viewports()
+{
+	for (size_t i = 0; i < m_viewports.size(); i++) {
+		auto viewport = m_viewports[i].viewport;
+		if (viewport == nullptr) continue;
+
+		auto camera = viewport->get_camera();
+		if (camera == nullptr) continue;
+
+		Effekseer::Matrix44 matrix = EffekseerGodot::ToEfkMatrix44(camera->get_camera_transform().inverse());
+		m_renderer->SetCameraMatrix(matrix);
+
+		if (m_cullingWorldSize > 0.0f) {
+			Effekseer::Matrix44 viewProjection;
+			Effekseer::Matrix44::Mul(viewProjection, matrix, GetCameraProjection(camera, viewport));
+			for (auto& layer : m_layers) {
+				layer.manager->CalcCulling(viewProjection, false);
+			}
+		}
+
+		// All handles of the viewport are drawn in one pass, so the StandardRenderer can merge them
+		Effekseer::Manager::DrawParameter params;
+		params.CameraCullingMask = 1 << (int32_t)i;
+		if (m_warmUpHandles.size() > 0) {
+			params.CameraCullingMask |= 1 << WarmUpDrawLayer;
+		}
+
+		m_renderer->BeginRendering();
+		for (auto& layer : m_layers) {
+			layer.manager->Draw(params);
+		}
+		if (m_warmUpHandles.size() > 0) {
+			m_warmUpManager->Draw(params);
+		}
+		m_renderer->EndRendering();
+	}
 }
 
-void EffekseerSystem::draw2D(Effekseer::Handle handle, const Transform2D& camera_transform)
+void EffekseerSystem::draw2D(int layer, const std::vector<Effekseer::Handle>& handles, const Transform2D& camera_transform)
 {
+	wait_update();
+
 	Effekseer:: Matrix44 matrix = EffekseerGodot::ToEfkMatrix44(camera_transform.inverse());
 	matrix.Values[3][2] = -1.0f; // Z offset
 	m_renderer->SetCameraMatrix(matrix);
 
+	// Canvas items are parented to each emitter, so 2D passes are not shared between emitters
 	m_renderer->BeginRendering();
-	m_manager->DrawHandle(handle);
+	for (auto handle : handles) {
+		get_manager_2d(layer)->DrawHandle(handle);
+	}
 	m_renderer->EndRendering();
 }
 
+int EffekseerSystem::attach_viewport(Viewport* viewport)
+{
+	int index = -1;
+	for (size_t i = 0; i < m_viewports.size(); i++) {
+		if (m_viewports[i].viewport == viewport) {
+			m_viewports[i].refCount++;
+			return (int)i;
+		}
+		if (index < 0 && m_viewports[i].viewport == nullptr) {
+			index = (int)i;
+		}
+	}
+
+	if (index < 0) {
+		if (m_viewports.size() >= WarmUpDrawLayer) {
+			Godot::print_error("Too many viewports with effects, the effects are not drawn", __FUNCTION__, "", __LINE__);
+			return -1;
+		}
+		index = (int)m_viewports.size();
+		m_viewports.emplace_back();
+	}
+
+	m_viewports[index].viewport = viewport;
+	m_viewports[index].refCount = 1;
+	return index;
+}
+
+void EffekseerSystem::update_transforms()
+{
+	// Transform notifications are sent after _process, too late for this frame's update,
+	// so the emitters compare their global transform instead and only the moved ones send base matrices
+	for (auto emitter : m_emitters3D) {
+		emitter->update_transform();
+	}
+}
+
+void EffekseerSystem::register_emitter(EffekseerEmitter* emitter)
+{
+	if (emitter->m_transformIndex >= 0) {
+		return;
+	}
+
+	emitter->m_transformIndex = (int)m_emitters3D.size();
+	m_emitters3D.push_back(emitter);
+}
+
+void EffekseerSystem::unregister_emitter(EffekseerEmitter* emitter)
+{
+	const int index = emitter->m_transformIndex;
+	if (index < 0) {
+		return;
+	}
+
+	// Swap with the last one to keep the list dense
+	auto last = m_emitters3D.back();
+	m_emitters3D[index] = last;
+	last->m_transformIndex = index;
+	m_emitters3D.pop_back();
+	emitter->m_transformIndex = -1;
+}
+
+void EffekseerSystem::register_emitter(EffekseerEmitter2D* emitter)
+{
+	if (emitter->m_drawIndex >= 0) {
+		return;
+	}
+
+	emitter->m_drawIndex = (int)m_emitters2D.size();
+	m_emitters2D.push_back(emitter);
+}
+
+void EffekseerSystem::unregister_emitter(EffekseerEmitter2D* emitter)
+{
+	const int index = emitter->m_drawIndex;
+	if (index < 0) {
+		return;
+	}
+
+	// Swap with the last one to keep the list dense
+	auto last = m_emitters2D.back();
+	m_emitters2D[index] = last;
+	last->m_drawIndex = index;
+	m_emitters2D.pop_back();
+	emitter->m_drawIndex = -1;
+}
+
+void EffekseerSystem::detach_viewport(int index)
+{
+	if (index < 0 || index >= (int)m_viewports.size()) {
+		return;
+	}
+
+	if (--m_viewports[index].refCount <= 0) {
+		m_viewports[index].viewport = nullptr;
+		m_viewports[index].refCount = 0;
+	}
+}
+
 void EffekseerSystem::stop_all_effects()
 {
-	m_manager->StopAllEffects();
+	wait_update();
+	for (auto& layer : m_layers) {
+		layer.manager->StopAllEffects();
+		if (layer.manager2D != nullptr) {
+			layer.manager2D->StopAllEffects();
+		}
+	}
 }
 
 void EffekseerSystem::set_paused_to_all_effects(bool paused)
 {
-	m_manager->SetPausedToAllEffects(paused);
+	wait_update();
+	for (auto& layer : m_layers) {
+		layer.manager->SetPausedToAllEffects(paused);
+		if (layer.manager2D != nullptr) {
+			layer.manager2D->SetPausedToAllEffects(paused);
+		}
+	}
 }
 
 int EffekseerSystem::get_total_instance_count() const
 {
-	return m_manager->GetTotalInstanceCount();
+	wait_update();
+	int count = 0;
+	for (auto& layer : m_layers) {
+		count += layer.manager->GetTotalInstanceCount();
+		if (layer.manager2D != nullptr) {
+			count += layer.manager2D->GetTotalInstanceCount();
+		}
+	}
+	return count;
+}
+
+static Dictionary ToDictionary(const EffekseerGodot::ResourceCacheStatistics& stats)
+{
+	Dictionary result;
+	result["hit_count"] = stats.HitCount;
+	result["miss_count"] = stats.MissCount;
+	result["live_count"] = stats.LiveCount;
+	result["live_bytes"] = stats.LiveBytes;
+	return result;
+}
+
+Dictionary EffekseerSystem::get_loader_statistics() const
+{
+	auto setting = m_layers[0].manager->GetSetting();
+
+	Dictionary result;
+	if (auto loader = setting->GetTextureLoader().DownCast<EffekseerGodot::TextureLoader>()) {
+		result["texture"] = ToDictionary(loader->GetStatistics());
+	}
+	if (auto loader = setting->GetModelLoader().DownCast<EffekseerGodot::ModelLoader>()) {
+		result["model"] = ToDictionary(loader->GetStatistics());
+	}
+	if (auto loader = setting->GetMaterialLoader().DownCast<EffekseerGodot::MaterialLoader>()) {
+		result["material"] = ToDictionary(loader->GetStatistics());
+	}
+	if (auto loader = setting->GetCurveLoader().DownCast<EffekseerGodot::CurveLoader>()) {
+		result["curve"] = ToDictionary(loader->GetStatistics());
+	}
+	return result;
+}
+
+Dictionary EffekseerSystem::get_render_statistics() const
+{
+	auto stats = m_renderer->GetStatistics();
+
+	Dictionary result;
+	result["draw_command_count"] = stats.DrawCommandCount;
+	result["draw_command_allocated"] = stats.DrawCommandAllocatedCount;
+	result["draw_command_high_water_mark"] = stats.DrawCommandHighWaterMark;
+	result["draw_command_2d_count"] = stats.DrawCommand2DCount;
+	result["draw_command_2d_allocated"] = stats.DrawCommand2DAllocatedCount;
+	result["draw_command_2d_high_water_mark"] = stats.DrawCommand2DHighWaterMark;
+	result["dropped_draw_count"] = stats.DroppedDrawCount;
+	result["merged_draw_count"] = stats.MergedDrawCount;
+	result["vertex_texture_pages"] = stats.VertexTexturePageCount;
+	result["vertex_texture_used"] = stats.VertexTextureUsedTexels;
+	result["vertex_texture_capacity"] = stats.VertexTextureCapacityTexels;
+	result["vertex_texture_overflow_count"] = stats.VertexTextureOverflowCount;
+	return result;
+}
+
+PoolStringArray EffekseerSystem::get_shader_variants() const
+{
+	return EffekseerGodot::Shader::GetUsedVariants();
+}
+
+bool EffekseerSystem::save_shader_variants(String path)
+{
+	Ref<File> file = File::_new();
+	if (file->open(path, File::WRITE) != Error::OK) {
+		return false;
+	}
+
+	auto variants = EffekseerGodot::Shader::GetUsedVariants();
+	for (int i = 0; i < variants.size(); i++) {
+		file->store_line(variants[i]);
+	}
+	file->close();
+	return true;
 }
 
 }
@@ -1,10 +1,16 @@
 #pragma once
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <Godot.hpp>
 #include <World.hpp>
 #include <Camera.hpp>
 #include <Camera2D.hpp>
 #include <Node.hpp>
+#include <Viewport.hpp>
 #include <Effekseer.h>
 #include "RendererGodot/EffekseerGodot.Renderer.h"
 #include "SoundGodot/EffekseerGodot.SoundPlayer.h"
@@ -17,6 +23,8 @@ class Renderer;
 namespace godot {
 
 class EffekseerEffect;
+class EffekseerEmitter;
+class EffekseerEmitter2D;
 
 class EffekseerSystem : public Node
 {
@@ -41,9 +49,29 @@ public:
 
 	void _update_draw();
 
-	void draw3D(Effekseer::Handle handle, const Transform& camera_transform);
+	void _begin_async_update();
 
-	void draw2D(Effekseer::Handle handle, const Transform2D& camera_transform);
+	void draw2D(int layer, const std::vector<Effekseer::Handle>& handles, const Transform2D& camera_transform);
+
+	int attach_viewport(Viewport* viewport);
+
+	void detach_viewport(int index);
+
+	void register_emitter(EffekseerEmitter* emitter);
+
+	void unregister_emitter(EffekseerEmitter* emitter);
+
+	void register_emitter(EffekseerEmitter2D* emitter);
+
+	void unregister_emitter(EffekseerEmitter2D* emitter);
+
+	void load_effect_async(Ref<EffekseerEffect> effect);
+
+	void setup_effect(Ref<EffekseerEffect> effect);
+
+	void preload(Array effects, float budget_ms, bool warm_up);
+
+	float get_preload_progress() const;
 
 	void stop_all_effects();
 
@@ -51,13 +79,152 @@ public:
 
 	int get_total_instance_count() const;
 
-	const Effekseer::ManagerRef& get_manager() { return m_manager; }
+	Dictionary get_render_statistics() const;
+
+	Dictionary get_loader_statistics() const;
+
+	PoolStringArray get_shader_variants() const;
+
+	bool save_shader_variants(String path);
+
+	void set_worker_thread_count(int count);
+
+	int get_worker_thread_count() const { return m_workerThreadCount; }
+
+	int find_layer(String name) const;
+
+	void set_layer_paused(String name, bool paused);
+
+	bool is_layer_paused(String name) const;
+
+	void set_layer_tick_rate(String name, float tick_rate);
+
+	float get_layer_tick_rate(String name) const;
+
+	void set_quality_scale(float scale) { m_qualityScale = std::max(0.0f, scale); }
+
+	float get_quality_scale() const { return m_qualityScale; }
+
+	bool is_data_released_after_setup() const { return m_releaseDataAfterSetup; }
+
+	const Effekseer::ManagerRef& get_manager(int layer = 0) { wait_update(); return m_layers[layer].manager; }
+
+	const Effekseer::ManagerRef& get_manager_2d(int layer = 0);
+
+	// Effekseer layer of handles which are not drawn by the viewport passes (2D or detached)
+	static const int32_t DetachedDrawLayer = 31;
+
+	// Effekseer layer of the transparent handles drawn once by preload() to create the GPU pipelines
+	static const int32_t WarmUpDrawLayer = 30;
 
 private:
+	// 3D handles are drawn per viewport in one pass, selected by the Effekseer layer of the same index
+	struct DrawViewport
+	{
+		Viewport* viewport = nullptr;
+		int32_t refCount = 0;
+	};
+	// Effects are updated in layers, each with its own manager, instance pool, tick rate and pause state
+	struct Layer
+	{
+		String name;
+		Effekseer::ManagerRef manager;
+		// 2D handles are kept out of the culling world, created on first use
+		Effekseer::ManagerRef manager2D;
+		int32_t instanceMaxCount = 0;
+		float tickRate = 60.0f;
+		float accumulator = 0.0f;
+		int32_t pendingSteps = 0;
+		bool paused = false;
+	};
+
+	Effekseer::ManagerRef create_manager(int32_t instanceMaxCount);
+
+	void add_layer(String name, int32_t instanceMaxCount, float tickRate);
+
+	void draw_viewports();
+
+	void update_transforms();
+
+	void update_effect_loads();
+
+	void update_preloads();
+
+	void warm_up_effect(Ref<EffekseerEffect> effect, Camera* camera);
+
+	void finish_preload();
+
+	void start_load_thread();
+
+	void stop_load_thread();
+
+	void update_layers();
+
+	void update_manager(Layer& layer, int32_t steps, int64_t startTime);
+
+	void wait_update() const;
+
+	void start_update_thread();
+
+	void stop_update_thread();
+
 	static EffekseerSystem* s_instance;
 
-	Effekseer::ManagerRef m_manager;
+	std::vector<Layer> m_layers;
+	std::vector<DrawViewport> m_viewports;
+	std::vector<EffekseerEmitter2D*> m_emitters2D;
+	std::vector<EffekseerEmitter*> m_emitters3D;
 	EffekseerGodot::RendererRef m_renderer;
+	EffekseerGodot::SoundPlayerRef m_soundPlayer;
+	int32_t m_workerThreadCount = 0;
+	float m_shaderPrewarmBudget = 2.0f;
+	bool m_shaderPrewarmPending = false;
+	int32_t m_updateMaxSteps = 4;
+	int64_t m_updateBudget = 0;
+	float m_cullingWorldSize = 1000.0f;
+	float m_qualityScale = 1.0f;
+
+	// Asynchronous update runs between the end of drawing and the next access to the manager
+	bool m_asyncUpdate = false;
+	bool m_asyncUpdatePending = false;
+	std::thread m_updateThread;
+	mutable std::mutex m_updateMutex;
+	mutable std::condition_variable m_updateCondition;
+	bool m_updateRequested = false;
+	bool m_updateThreadExit = false;
+
+	// Effects set up by setup_async() are created on the load thread and finished on the main thread
+	struct EffectLoad
+	{
+		Ref<EffekseerEffect> effect;
+		Effekseer::EffectRef native;
+		int32_t modelIndex = 0;
+	};
+	std::thread m_loadThread;
+	std::mutex m_loadMutex;
+	std::condition_variable m_loadCondition;
+	std::deque<Ref<EffekseerEffect>> m_loadRequests;
+	std::deque<EffectLoad> m_loadResults;
+	bool m_loadThreadExit = false;
+	float m_loadBudget = 2.0f;
+	bool m_asyncEffectSetup = false;
+	bool m_releaseDataAfterSetup = false;
+
+	// Effects requested by preload(), set up and warmed up a few per frame
+	struct EffectPreload
+	{
+		Ref<EffekseerEffect> effect;
+		bool warmUp = false;
+		bool setupRequested = false;
+	};
+	std::vector<EffectPreload> m_preloads;
+	std::vector<Effekseer::Handle> m_warmUpHandles;
+	Effekseer::ManagerRef m_warmUpManager;
+	Ref<World> m_warmUpWorld;
+	int32_t m_warmUpInstanceMaxCount = 2000;
+	int32_t m_preloadCount = 0;
+	bool m_preloadFinishPending = false;
+	float m_preloadBudget = 2.0f;
 };
 
 }
@@ -8,6 +8,11 @@ namespace EffekseerGodot
 
 Effekseer::CurveRef CurveLoader::Load(const char16_t* path)
 {
+	if (auto cached = m_cache.Find(path))
+	{
+		return cached;
+	}
+
 	// Load by Godot
 	auto loader = godot::ResourceLoader::get_singleton();
 	auto resource = loader->load(ToGdString(path), "");
@@ -17,9 +22,17 @@ Effekseer::CurveRef CurveLoader::Load(const char16_t* path)
 	}
 
 	auto efkres = godot::as<godot::EffekseerResource>(resource.ptr());
-	auto& data = efkres->get_data_ref();
+	auto data = efkres->acquire_data();
 
-	return Load(data.read().ptr(), data.size());
+	auto curve = Load(data.read().ptr(), data.size());
+	if (curve == nullptr)
+	{
+		return nullptr;
+	}
+
+	// Effekseer keeps its own copy
+	efkres->release_data();
+	return m_cache.Add(path, curve, data.size());
 }
 
 Effekseer::CurveRef CurveLoader::Load(const void* data, int32_t size)
@@ -29,6 +42,10 @@ Effekseer::CurveRef CurveLoader::Load(const void* data, int32_t size)
 
 void CurveLoader::Unload(Effekseer::CurveRef data)
 {
+	if (data != nullptr)
+	{
+		m_cache.Release(data);
+	}
 }
 
 } // namespace EffekseerGodot
@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include <Effekseer.h>
+#include "EffekseerGodot.ResourceCache.h"
 
 namespace EffekseerGodot
 {
@@ -17,6 +18,11 @@ public:
 	Effekseer::CurveRef Load(const void* data, int32_t size);// override;
 
 	void Unload(Effekseer::CurveRef data) override;
+
+	ResourceCacheStatistics GetStatistics() const { return m_cache.GetStatistics(); }
+
+private:
+	ResourceCache<Effekseer::CurveRef> m_cache;
 };
 
 } // namespace EffekseerGodot
@@ -1,4 +1,5 @@
-﻿#include <ResourceLoader.hpp>
+﻿#include <cstring>
+#include <ResourceLoader.hpp>
 #include "EffekseerGodot.MaterialLoader.h"
 #include "../RendererGodot/EffekseerGodot.ShaderGenerator.h"
 #include "../RendererGodot/EffekseerGodot.Shader.h"
@@ -9,23 +10,221 @@
 namespace EffekseerGodot
 {
 
+// Baked shaders: magic, version, hash of the material file, then ShaderMax entries of
+// constant buffer sizes, spatial code, canvas item code and raw parameter declarations
+static const uint32_t BakedShadersMagic = 0x424b4645; // "EFKB"
+static const uint32_t BakedShadersVersion = 1;
+
+static uint32_t HashMaterialData(const void* data, int32_t size)
+{
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	for (int32_t i = 0; i < size; i++)
+	{
+		hash = (hash ^ ((const uint8_t*)data)[i]) * 16777619u;
+	}
+	return hash;
+}
+
+class BakedShadersWriter
+{
+public:
+	template <typename T>
+	void Write(const T& value)
+	{
+		Write(&value, sizeof(T));
+	}
+
+	void Write(const void* data, size_t size)
+	{
+		m_buffer.insert(m_buffer.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+	}
+
+	void WriteString(const std::string& str)
+	{
+		Write((uint32_t)str.size());
+		Write(str.data(), str.size());
+	}
+
+	godot::PoolByteArray ToPoolByteArray() const
+	{
+		godot::PoolByteArray result;
+		result.resize((int)m_buffer.size());
+		memcpy(result.write().ptr(), m_buffer.data(), m_buffer.size());
+		return result;
+	}
+
+private:
+	std::vector<uint8_t> m_buffer;
+};
+
+class BakedShadersReader
+{
+public:
+	BakedShadersReader(const uint8_t* data, size_t size)
+		: m_data(data), m_size(size)
+	{
+	}
+
+	template <typename T>
+	bool Read(T& value)
+	{
+		return Read(&value, sizeof(T));
+	}
+
+	bool Read(void* data, size_t size)
+	{
+		if (m_offset + size > m_size)
+			return false;
+		memcpy(data, m_data + m_offset, size);
+		m_offset += size;
+		return true;
+	}
+
+	bool ReadString(std::string& str)
+	{
+		uint32_t length = 0;
+		if (!Read(length) || m_offset + length > m_size)
+			return false;
+		str.assign((const char*)m_data + m_offset, length);
+		m_offset += length;
+		return true;
+	}
+
+private:
+	const uint8_t* m_data;
+	size_t m_size;
+	size_t m_offset = 0;
+};
+
+static bool ReadBakedShaders(const godot::PoolByteArray& baked, uint32_t materialHash, ShaderData* shaderDataList)
+{
+	auto bakedData = baked.read();
+	BakedShadersReader reader(bakedData.ptr(), (size_t)baked.size());
+
+	uint32_t magic = 0, version = 0, hash = 0;
+	if (!reader.Read(magic) || !reader.Read(version) || !reader.Read(hash) ||
+		magic != BakedShadersMagic || version != BakedShadersVersion || hash != materialHash)
+	{
+		// Baked by another version or from an older material file
+		return false;
+	}
+
+	for (size_t i = 0; i < ShaderGenerator::ShaderMax; i++)
+	{
+		auto& shaderData = shaderDataList[i];
+		uint32_t paramCount = 0;
+		if (!reader.Read(shaderData.VertexConstantBufferSize) || !reader.Read(shaderData.PixelConstantBufferSize) ||
+			!reader.ReadString(shaderData.CodeSpatial) || !reader.ReadString(shaderData.CodeCanvasItem) ||
+			!reader.Read(paramCount))
+		{
+			return false;
+		}
+		shaderData.ParamDecls.resize(paramCount);
+		if (!reader.Read(shaderData.ParamDecls.data(), sizeof(Shader::ParamDecl) * paramCount))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+godot::PoolByteArray MaterialLoader::BakeShaders(const void* data, int32_t size)
+{
+	Effekseer::MaterialFile materialFile;
+	if (!materialFile.Load((const uint8_t*)data, size))
+	{
+		return godot::PoolByteArray();
+	}
+
+	ShaderGenerator shaderGenerator;
+	auto shaderDataList = shaderGenerator.Generate(materialFile);
+
+	BakedShadersWriter writer;
+	writer.Write(BakedShadersMagic);
+	writer.Write(BakedShadersVersion);
+	writer.Write(HashMaterialData(data, size));
+	for (auto& shaderData : shaderDataList)
+	{
+		writer.Write(shaderData.VertexConstantBufferSize);
+		writer.Write(shaderData.PixelConstantBufferSize);
+		writer.WriteString(shaderData.CodeSpatial);
+		writer.WriteString(shaderData.CodeCanvasItem);
+		writer.Write((uint32_t)shaderData.ParamDecls.size());
+		writer.Write(shaderData.ParamDecls.data(), sizeof(Shader::ParamDecl) * shaderData.ParamDecls.size());
+	}
+	return writer.ToPoolByteArray();
+}
+
+void MaterialLoader::AddBakedShaders(const godot::String& path, const godot::PoolByteArray& baked)
+{
+	std::lock_guard<std::mutex> lock(m_bakedMutex);
+
+	auto& entry = m_bakedShaders[path.simplify_path().utf8().get_data()];
+	entry.data = baked;
+	entry.refCount++;
+}
+
+void MaterialLoader::RemoveBakedShaders(const godot::String& path)
+{
+	std::lock_guard<std::mutex> lock(m_bakedMutex);
+
+	auto it = m_bakedShaders.find(path.simplify_path().utf8().get_data());
+	if (it != m_bakedShaders.end() && --it->second.refCount <= 0)
+	{
+		m_bakedShaders.erase(it);
+	}
+}
+
 ::Effekseer::MaterialRef MaterialLoader::Load(const char16_t* path)
 {
+	// Effects referring to the same file share one material and its shaders
+	if (auto cached = m_cache.Find(path))
+	{
+		return cached;
+	}
+
 	// Load by Godot
+	godot::String gdpath = ToGdString(path);
 	auto loader = godot::ResourceLoader::get_singleton();
-	auto resource = loader->load(ToGdString(path), "");
+	auto resource = loader->load(gdpath, "");
 	if (!resource.is_valid())
 	{
 		return nullptr;
 	}
 
 	auto efkres = godot::as<godot::EffekseerResource>(resource.ptr());
-	auto& data = efkres->get_data_ref();
+	auto data = efkres->acquire_data();
+
+	godot::PoolByteArray baked;
+	{
+		std::lock_guard<std::mutex> lock(m_bakedMutex);
+		auto it = m_bakedShaders.find(gdpath.simplify_path().utf8().get_data());
+		if (it != m_bakedShaders.end())
+		{
+			baked = it->second.data;
+		}
+	}
 
-	return Load(data.read().ptr(), data.size(), Effekseer::MaterialFileType::Code);
+	auto material = LoadMaterial(data.read().ptr(), data.size(), (baked.size() > 0) ? &baked : nullptr);
+	if (material == nullptr)
+	{
+		return nullptr;
+	}
+
+	// The shaders are generated, the file is not needed anymore
+	efkres->release_data();
+
+	auto cached = m_cache.Add(path, material, data.size());
+	if (cached != material)
+	{
+		// Another thread has loaded the same material meanwhile
+		Unload(material);
+	}
+	return cached;
 }
 
-::Effekseer::MaterialRef MaterialLoader::LoadAcutually(const ::Effekseer::MaterialFile& materialFile)
+::Effekseer::MaterialRef MaterialLoader::LoadAcutually(const ::Effekseer::MaterialFile& materialFile, const ShaderData* shaderDataList)
 {
 	using namespace EffekseerRenderer;
 
@@ -33,9 +232,6 @@ namespace EffekseerGodot
 	material->IsSimpleVertex = materialFile.GetIsSimpleVertex();
 	material->IsRefractionRequired = materialFile.GetHasRefraction();
 
-	ShaderGenerator shaderGenerator;
-	auto shaderDataList = shaderGenerator.Generate(materialFile);
-
 	{
 		auto shader = Shader::Create("Custom_Sprite", RendererShaderType::Material);
 		shader->SetVertexConstantBufferSize(shaderDataList[0].VertexConstantBufferSize);
@@ -72,15 +268,26 @@ namespace EffekseerGodot
 }
 
 ::Effekseer::MaterialRef MaterialLoader::Load(const void* data, int32_t size, Effekseer::MaterialFileType fileType)
+{
+	return LoadMaterial(data, size, nullptr);
+}
+
+::Effekseer::MaterialRef MaterialLoader::LoadMaterial(const void* data, int32_t size, const godot::PoolByteArray* baked)
 {
 	Effekseer::MaterialFile materialFile;
+	if (!materialFile.Load((const uint8_t*)data, size))
+	{
+		return nullptr;
+	}
 
-	if (materialFile.Load((const uint8_t*)data, size))
+	std::array<ShaderData, ShaderGenerator::ShaderMax> shaderDataList;
+	if (baked == nullptr || !ReadBakedShaders(*baked, HashMaterialData(data, size), shaderDataList.data()))
 	{
-		return LoadAcutually(materialFile);
+		ShaderGenerator shaderGenerator;
+		shaderDataList = shaderGenerator.Generate(materialFile);
 	}
 
-	return nullptr;
+	return LoadAcutually(materialFile, shaderDataList.data());
 }
 
 void MaterialLoader::Unload(::Effekseer::MaterialRef data)
@@ -88,6 +295,10 @@ void MaterialLoader::Unload(::Effekseer::MaterialRef data)
 	if (data == nullptr)
 		return;
 
+	// Shaders are shared while the material is still referenced by other effects
+	if (!m_cache.Release(data))
+		return;
+
 	auto shader = reinterpret_cast<Shader*>(data->UserPtr);
 	auto modelShader = reinterpret_cast<Shader*>(data->ModelUserPtr);
 	auto refractionShader = reinterpret_cast<Shader*>(data->RefractionUserPtr);
@@ -1,6 +1,12 @@
 ﻿#pragma once
 
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <String.hpp>
+#include <PoolArrays.hpp>
 #include <Effekseer.h>
+#include "EffekseerGodot.ResourceCache.h"
 
 namespace Effekseer
 {
@@ -10,6 +16,8 @@ class MaterialFile;
 namespace EffekseerGodot
 {
 
+struct ShaderData;
+
 class MaterialLoader : public ::Effekseer::MaterialLoader
 {
 public:
@@ -23,8 +31,30 @@ public:
 
 	void Unload(::Effekseer::MaterialRef data) override;
 
+	ResourceCacheStatistics GetStatistics() const { return m_cache.GetStatistics(); }
+
+	// Generates the shaders of a material file in the binary form stored by the effect importer
+	static godot::PoolByteArray BakeShaders(const void* data, int32_t size);
+
+	// Baked shaders are used instead of generating them while an effect referring to the path is created
+	void AddBakedShaders(const godot::String& path, const godot::PoolByteArray& baked);
+
+	void RemoveBakedShaders(const godot::String& path);
+
 private:
-	::Effekseer::MaterialRef LoadAcutually(const ::Effekseer::MaterialFile& materialFile);
+	::Effekseer::MaterialRef LoadMaterial(const void* data, int32_t size, const godot::PoolByteArray* baked);
+
+	::Effekseer::MaterialRef LoadAcutually(const ::Effekseer::MaterialFile& materialFile, const ShaderData* shaderDataList);
+
+	struct BakedShaders
+	{
+		godot::PoolByteArray data;
+		int32_t refCount = 0;
+	};
+
+	ResourceCache<::Effekseer::MaterialRef> m_cache;
+	std::mutex m_bakedMutex;
+	std::unordered_map<std::string, BakedShaders> m_bakedShaders;
 };
 
 } // namespace EffekseerGodot
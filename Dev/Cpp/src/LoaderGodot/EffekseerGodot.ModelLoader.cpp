@@ -9,6 +9,12 @@ namespace EffekseerGodot
 
 Effekseer::ModelRef ModelLoader::Load(const char16_t* path)
 {
+	// Effects referring to the same file share one model and its mesh
+	if (auto cached = m_cache.Find(path))
+	{
+		return cached;
+	}
+
 	// Load by Godot
 	auto loader = godot::ResourceLoader::get_singleton();
 	auto resource = loader->load(ToGdString(path), "");
@@ -18,9 +24,17 @@ Effekseer::ModelRef ModelLoader::Load(const char16_t* path)
 	}
 
 	auto efkres = godot::as<godot::EffekseerResource>(resource.ptr());
-	auto& data = efkres->get_data_ref();
+	auto data = efkres->acquire_data();
 
-	return Load(data.read().ptr(), data.size());
+	auto model = Load(data.read().ptr(), data.size());
+	if (model == nullptr)
+	{
+		return nullptr;
+	}
+
+	// Effekseer keeps its own copy
+	efkres->release_data();
+	return m_cache.Add(path, model, data.size());
 }
 
 Effekseer::ModelRef ModelLoader::Load(const void* data, int32_t size)
@@ -30,6 +44,10 @@ Effekseer::ModelRef ModelLoader::Load(const void* data, int32_t size)
 
 void ModelLoader::Unload(Effekseer::ModelRef data)
 {
+	if (data != nullptr)
+	{
+		m_cache.Release(data);
+	}
 }
 
 } // namespace EffekseerGodot
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <Effekseer.h>
+
+namespace EffekseerGodot
+{
+
+struct ResourceCacheStatistics
+{
+	int64_t HitCount = 0;
+	int64_t MissCount = 0;
+	int32_t LiveCount = 0;
+	int64_t LiveBytes = 0;
+};
+
+// Shares the resources loaded from the same path between effects, counting the references
+template <typename T>
+class ResourceCache
+{
+public:
+	T Find(const char16_t* path)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto it = m_entries.find(path);
+		if (it == m_entries.end())
+		{
+			m_statistics.MissCount++;
+			return nullptr;
+		}
+
+		m_statistics.HitCount++;
+		it->second.refCount++;
+		return it->second.resource;
+	}
+
+	// Returns the cached one if the same path was added by another thread meanwhile
+	T Add(const char16_t* path, const T& resource, int64_t size)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto result = m_entries.emplace(path, Entry{ resource, 0, size });
+		auto& entry = result.first->second;
+		entry.refCount++;
+
+		if (result.second)
+		{
+			m_paths.emplace(resource.Get(), path);
+			m_statistics.LiveCount++;
+			m_statistics.LiveBytes += size;
+		}
+		return entry.resource;
+	}
+
+	// Returns true if the resource is not referenced anymore and removed from the cache
+	bool Release(const T& resource)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto pathIt = m_paths.find(resource.Get());
+		if (pathIt == m_paths.end())
+		{
+			return true;
+		}
+
+		auto it = m_entries.find(pathIt->second);
+		if (--it->second.refCount > 0)
+		{
+			return false;
+		}
+
+		m_statistics.LiveCount--;
+		m_statistics.LiveBytes -= it->second.size;
+		m_entries.erase(it);
+		m_paths.erase(pathIt);
+		return true;
+	}
+
+	ResourceCacheStatistics GetStatistics() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_statistics;
+	}
+
+private:
+	struct Entry
+	{
+		T resource;
+		int32_t refCount;
+		int64_t size;
+	};
+
+	mutable std::mutex m_mutex;
+	std::unordered_map<std::u16string, Entry> m_entries;
+	std::unordered_map<const void*, std::u16string> m_paths;
+	ResourceCacheStatistics m_statistics;
+};
+
+} // namespace EffekseerGodot
@@ -10,6 +10,11 @@ namespace EffekseerGodot
 
 Effekseer::TextureRef TextureLoader::Load(const char16_t* path, Effekseer::TextureType textureType)
 {
+	if (auto cached = m_cache.Find(path))
+	{
+		return cached;
+	}
+
 	godot::String gdpath = ToGdString(path);
 
 	// Load by Godot
@@ -43,11 +48,17 @@ Effekseer::TextureRef TextureLoader::Load(const char16_t* path, Effekseer::Textu
 
 	auto result = Effekseer::MakeRefPtr<Effekseer::Texture>();
 	result->SetBackend(backend);
-	return result;
+
+	// The size is estimated as uncompressed RGBA8 without mipmaps
+	return m_cache.Add(path, result, (int64_t)backend->size_[0] * backend->size_[1] * 4);
 }
 
 void TextureLoader::Unload(Effekseer::TextureRef textureData)
 {
+	if (textureData != nullptr)
+	{
+		m_cache.Release(textureData);
+	}
 }
 
 } // namespace EffekseerGodot
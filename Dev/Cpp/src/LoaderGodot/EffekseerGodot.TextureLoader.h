@@ -1,6 +1,7 @@
 #pragma once
 
 #include <Effekseer.h>
+#include "EffekseerGodot.ResourceCache.h"
 
 namespace EffekseerGodot
 {
@@ -12,6 +13,10 @@ public:
 	virtual ~TextureLoader() = default;
 	Effekseer::TextureRef Load(const char16_t* path, Effekseer::TextureType textureType) override;
 	void Unload(Effekseer::TextureRef texture) override;
+	ResourceCacheStatistics GetStatistics() const { return m_cache.GetStatistics(); }
+
+private:
+	ResourceCache<Effekseer::TextureRef> m_cache;
 };
 
 } // namespace EffekseerGodot
@@ -20,6 +20,7 @@ namespace Unlit
 {
 #define DISTORTION 0
 #define LIGHTING 0
+#define INSTANCING 0
 namespace Lightweight
 {
 #define SOFT_PARTICLE 0
@@ -36,6 +37,21 @@ namespace CanvasItem
 {
 #include "Shaders/Model2D.inl"
 }
+#undef INSTANCING
+#define INSTANCING 1
+namespace LightweightInstanced
+{
+#define SOFT_PARTICLE 0
+#include "Shaders/Model.inl"
+#undef SOFT_PARTICLE
+}
+namespace SoftParticleInstanced
+{
+#define SOFT_PARTICLE 1
+#include "Shaders/Model.inl"
+#undef SOFT_PARTICLE
+}
+#undef INSTANCING
 #undef LIGHTING
 #undef DISTORTION
 }
@@ -44,6 +60,7 @@ namespace Lighting
 {
 #define DISTORTION 0
 #define LIGHTING 1
+#define INSTANCING 0
 namespace Lightweight
 {
 #define SOFT_PARTICLE 0
@@ -60,6 +77,21 @@ namespace CanvasItem
 {
 #include "Shaders/Model2D.inl"
 }
+#undef INSTANCING
+#define INSTANCING 1
+namespace LightweightInstanced
+{
+#define SOFT_PARTICLE 0
+#include "Shaders/Model.inl"
+#undef SOFT_PARTICLE
+}
+namespace SoftParticleInstanced
+{
+#define SOFT_PARTICLE 1
+#include "Shaders/Model.inl"
+#undef SOFT_PARTICLE
+}
+#undef INSTANCING
 #undef LIGHTING
 #undef DISTORTION
 }
@@ -68,6 +100,7 @@ namespace Distortion
 {
 #define DISTORTION 1
 #define LIGHTING 0
+#define INSTANCING 0
 namespace Lightweight
 {
 #define SOFT_PARTICLE 0
@@ -84,6 +117,21 @@ namespace CanvasItem
 {
 #include "Shaders/Model2D.inl"
 }
+#undef INSTANCING
+#define INSTANCING 1
+namespace LightweightInstanced
+{
+#define SOFT_PARTICLE 0
+#include "Shaders/Model.inl"
+#undef SOFT_PARTICLE
+}
+namespace SoftParticleInstanced
+{
+#define SOFT_PARTICLE 1
+#include "Shaders/Model.inl"
+#undef SOFT_PARTICLE
+}
+#undef INSTANCING
 #undef LIGHTING
 #undef DISTORTION
 }
@@ -97,25 +145,34 @@ ModelRenderer::ModelRenderer(RendererImplemented* renderer)
 	using namespace EffekseerGodot::ModelShaders;
 
 	m_shaders[(size_t)RendererShaderType::Unlit] = Shader::Create("Model_Basic_Unlit", RendererShaderType::Unlit);
-	m_shaders[(size_t)RendererShaderType::Unlit]->SetVertexConstantBufferSize(sizeof(ModelRendererVertexConstantBuffer<40>));
+	m_shaders[(size_t)RendererShaderType::Unlit]->SetVertexConstantBufferSize(sizeof(ModelRendererVertexConstantBuffer<InstanceBatchCount>));
 	m_shaders[(size_t)RendererShaderType::Unlit]->SetPixelConstantBufferSize(sizeof(PixelConstantBuffer));
 	m_shaders[(size_t)RendererShaderType::Unlit]->Compile(Shader::RenderType::SpatialLightweight, Unlit::Lightweight::code, Unlit::Lightweight::decl);
 	m_shaders[(size_t)RendererShaderType::Unlit]->Compile(Shader::RenderType::SpatialDepthFade, Unlit::SoftParticle::code, Unlit::SoftParticle::decl);
 	m_shaders[(size_t)RendererShaderType::Unlit]->Compile(Shader::RenderType::CanvasItem, Unlit::CanvasItem::code, Unlit::CanvasItem::decl);
+	m_shaders[(size_t)RendererShaderType::Unlit]->Compile(Shader::RenderType::SpatialLightweightInstanced, Unlit::LightweightInstanced::code, Unlit::LightweightInstanced::decl);
+	m_shaders[(size_t)RendererShaderType::Unlit]->Compile(Shader::RenderType::SpatialDepthFadeInstanced, Unlit::SoftParticleInstanced::code, Unlit::SoftParticleInstanced::decl);
+	m_shaders[(size_t)RendererShaderType::Unlit]->SetInstanceCount(InstanceBatchCount);
 
 	m_shaders[(size_t)RendererShaderType::Lit] = Shader::Create("Model_Basic_Lighting", RendererShaderType::Lit);
-	m_shaders[(size_t)RendererShaderType::Lit]->SetVertexConstantBufferSize(sizeof(ModelRendererVertexConstantBuffer<40>));
+	m_shaders[(size_t)RendererShaderType::Lit]->SetVertexConstantBufferSize(sizeof(ModelRendererVertexConstantBuffer<InstanceBatchCount>));
 	m_shaders[(size_t)RendererShaderType::Lit]->SetPixelConstantBufferSize(sizeof(PixelConstantBuffer));
 	m_shaders[(size_t)RendererShaderType::Lit]->Compile(Shader::RenderType::SpatialLightweight, Lighting::Lightweight::code, Lighting::Lightweight::decl);
 	m_shaders[(size_t)RendererShaderType::Lit]->Compile(Shader::RenderType::SpatialDepthFade, Lighting::SoftParticle::code, Lighting::SoftParticle::decl);
 	m_shaders[(size_t)RendererShaderType::Lit]->Compile(Shader::RenderType::CanvasItem, Lighting::CanvasItem::code, Lighting::CanvasItem::decl);
+	m_shaders[(size_t)RendererShaderType::Lit]->Compile(Shader::RenderType::SpatialLightweightInstanced, Lighting::LightweightInstanced::code, Lighting::LightweightInstanced::decl);
+	m_shaders[(size_t)RendererShaderType::Lit]->Compile(Shader::RenderType::SpatialDepthFadeInstanced, Lighting::SoftParticleInstanced::code, Lighting::SoftParticleInstanced::decl);
+	m_shaders[(size_t)RendererShaderType::Lit]->SetInstanceCount(InstanceBatchCount);
 
 	m_shaders[(size_t)RendererShaderType::BackDistortion] = Shader::Create("Model_Basic_Distortion", RendererShaderType::BackDistortion);
-	m_shaders[(size_t)RendererShaderType::BackDistortion]->SetVertexConstantBufferSize(sizeof(ModelRendererVertexConstantBuffer<40>));
+	m_shaders[(size_t)RendererShaderType::BackDistortion]->SetVertexConstantBufferSize(sizeof(ModelRendererVertexConstantBuffer<InstanceBatchCount>));
 	m_shaders[(size_t)RendererShaderType::BackDistortion]->SetPixelConstantBufferSize(sizeof(PixelConstantBuffer));
 	m_shaders[(size_t)RendererShaderType::BackDistortion]->Compile(Shader::RenderType::SpatialLightweight, Distortion::Lightweight::code, Distortion::Lightweight::decl);
 	m_shaders[(size_t)RendererShaderType::BackDistortion]->Compile(Shader::RenderType::SpatialDepthFade, Distortion::SoftParticle::code, Distortion::SoftParticle::decl);
 	m_shaders[(size_t)RendererShaderType::BackDistortion]->Compile(Shader::RenderType::CanvasItem, Distortion::CanvasItem::code, Distortion::CanvasItem::decl);
+	m_shaders[(size_t)RendererShaderType::BackDistortion]->Compile(Shader::RenderType::SpatialLightweightInstanced, Distortion::LightweightInstanced::code, Distortion::LightweightInstanced::decl);
+	m_shaders[(size_t)RendererShaderType::BackDistortion]->Compile(Shader::RenderType::SpatialDepthFadeInstanced, Distortion::SoftParticleInstanced::code, Distortion::SoftParticleInstanced::decl);
+	m_shaders[(size_t)RendererShaderType::BackDistortion]->SetInstanceCount(InstanceBatchCount);
 }
 
 //----------------------------------------------------------------------------------
@@ -176,8 +233,8 @@ void ModelRenderer::EndRendering(const efkModelNodeParam& parameter, void* userD
 		RendererImplemented,
 		Shader,
 		Effekseer::Model,
-		false,
-		1>(
+		true,
+		InstanceBatchCount>(
 		m_renderer,
 		m_shaders[(size_t)RendererShaderType::AdvancedLit].get(),
 		m_shaders[(size_t)RendererShaderType::AdvancedUnlit].get(),
@@ -23,6 +23,10 @@ using ModelRendererRef = Effekseer::RefPtr<ModelRenderer>;
 
 class ModelRenderer : public ::EffekseerRenderer::ModelRendererBase
 {
+public:
+	// Number of models drawn by one instanced draw
+	static const int32_t InstanceBatchCount = 40;
+
 private:
 	RendererImplemented* m_renderer = nullptr;
 	std::array<std::unique_ptr<Shader>, 6> m_shaders;
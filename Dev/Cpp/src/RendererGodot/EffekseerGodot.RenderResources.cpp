@@ -5,6 +5,7 @@
 #include <VisualServer.hpp>
 #include "../Utils/EffekseerGodot.Utils.h"
 #include "EffekseerGodot.RenderResources.h"
+#include "EffekseerGodot.Shader.h"
 
 //-----------------------------------------------------------------------------------
 //
@@ -12,9 +13,26 @@
 namespace EffekseerGodot
 {
 
+Texture::~Texture()
+{
+	if (textureRid_.is_valid())
+	{
+		Shader::ForgetTextureFlags(textureRid_);
+	}
+}
+
 Model::Model(const void* data, int32_t size)
 	: Effekseer::Model(data, size)
 {
+}
+
+bool Model::CreateMesh()
+{
+	if (meshRid_.is_valid())
+	{
+		return false;
+	}
+
 	int32_t vertexCount = GetVertexCount();
 	const Vertex* vertexData = GetVertexes();
 	int32_t faceCount = GetFaceCount();
@@ -57,6 +75,7 @@ Model::Model(const void* data, int32_t size)
 	auto vs = godot::VisualServer::get_singleton();
 	meshRid_ = vs->mesh_create();
 	vs->mesh_add_surface_from_arrays(meshRid_, godot::VisualServer::PRIMITIVE_TRIANGLES, arrays);
+	return true;
 }
 
 Model::~Model()
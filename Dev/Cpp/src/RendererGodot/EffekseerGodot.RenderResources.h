@@ -10,6 +10,7 @@ namespace EffekseerGodot
 class Texture : public Effekseer::Backend::Texture
 {
 public:
+	~Texture();
 	godot::RID GetRID() const { return textureRid_; }
 
 private:
@@ -24,7 +25,10 @@ class Model : public Effekseer::Model
 public:
 	Model(const void* data, int32_t size);
 	~Model();
-	godot::RID GetRID() const { return meshRid_; }
+	godot::RID GetRID() { CreateMesh(); return meshRid_; }
+
+	// The mesh is created on the main thread, on first use or by the effect loader
+	bool CreateMesh();
 
 private:
 	friend class ModelLoader;
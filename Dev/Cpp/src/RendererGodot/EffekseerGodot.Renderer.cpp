@@ -113,6 +113,44 @@ namespace CanvasItem
 
 static constexpr int32_t CUSTOM_DATA_TEXTURE_WIDTH = 256;
 static constexpr int32_t CUSTOM_DATA_TEXTURE_HEIGHT = 256;
+static constexpr int32_t VertexTexturePageTexels = CUSTOM_DATA_TEXTURE_WIDTH * CUSTOM_DATA_TEXTURE_HEIGHT;
+static constexpr int32_t VertexTexturePageMaxCount = 8;
+
+// MultiMesh instance: transform (12), color (4) and custom data (4)
+static constexpr int32_t ModelInstanceStride = 20;
+
+// Offsets in ModelRendererVertexConstantBuffer<N> (camera matrix, then N model matrices, UVs and colors)
+inline size_t GetModelMatrixOffset(int32_t batchCount, int32_t index) { return 64 + 64 * index; }
+inline size_t GetModelUVOffset(int32_t batchCount, int32_t index) { return 64 + 64 * batchCount + 16 * index; }
+inline size_t GetModelColorOffset(int32_t batchCount, int32_t index) { return 64 + 80 * batchCount + 16 * index; }
+inline size_t GetModelTrailerOffset(int32_t batchCount) { return 64 + 96 * batchCount; }
+
+inline uint16_t FloatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	const uint32_t sign = (bits >> 16) & 0x8000;
+	const int32_t exponent = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+	const uint32_t mantissa = bits & 0x007fffff;
+
+	if (exponent <= 0)
+	{
+		// Denormals are flushed to zero
+		return (uint16_t)sign;
+	}
+	if (exponent >= 31)
+	{
+		return (uint16_t)(sign | 0x7c00);
+	}
+	// Round to nearest
+	uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+	if (mantissa & 0x1000)
+	{
+		half++;
+	}
+	return (uint16_t)half;
+}
 
 DynamicTexture::DynamicTexture()
 {
@@ -124,12 +162,29 @@ DynamicTexture::~DynamicTexture()
 	vs->free_rid(m_imageTexture);
 }
 
-void DynamicTexture::Init(int32_t width, int32_t height)
+void DynamicTexture::Init(int32_t width, int32_t height, VertexTextureFormat format)
 {
-	auto vs = godot::VisualServer::get_singleton();
+	const auto imageFormat = (format == VertexTextureFormat::RGBAH) ? 
+		godot::Image::FORMAT_RGBAH : godot::Image::FORMAT_RGBAF;
+	const int32_t texelSize = (format == VertexTextureFormat::RGBAH) ? 8 : 16;
+
+	m_format = format;
+	m_width = width;
+	m_height = height;
+
+	// Staging memory is allocated once at the full size
+	m_stagingData.resize(width * height * texelSize);
+	if (format == VertexTextureFormat::RGBAH)
+	{
+		m_halfSource.resize(width * height * 4);
+	}
+
+	// The image has its own buffer, sharing the staging one would copy it on the next write
 	godot::Ref<godot::Image> image;
 	image.instance();
-	image->create(width, height, false, godot::Image::FORMAT_RGBAF);
+	image->create(width, height, false, imageFormat);
+
+	auto vs = godot::VisualServer::get_singleton();
 	m_imageTexture = vs->texture_create_from_image(image, 0);
 }
 
@@ -137,9 +192,13 @@ const DynamicTexture::LockedRect* DynamicTexture::Lock(int32_t x, int32_t y, int
 {
 	assert(m_lockedRect.ptr == nullptr);
 	assert(m_lockedRect.width == 0 && m_lockedRect.height == 0);
+	assert(x == 0 && width == m_width && y + height <= m_height);
 
-	m_rectData.resize(width * height * sizeof(godot::Color));
-	m_lockedRect.ptr = (float*)m_rectData.write().ptr();
+	// Floats are written directly, or converted to half floats on unlock
+	float* base = (m_format == VertexTextureFormat::RGBAH) ? 
+		m_halfSource.write().ptr() : (float*)m_stagingData.write().ptr();
+
+	m_lockedRect.ptr = base + y * m_width * 4;
 	m_lockedRect.pitch = width * sizeof(godot::Color);
 	m_lockedRect.x = x;
 	m_lockedRect.y = y;
@@ -153,18 +212,51 @@ void DynamicTexture::Unlock()
 	assert(m_lockedRect.ptr != nullptr);
 	assert(m_lockedRect.width > 0 && m_lockedRect.height > 0);
 
+	if (m_format == VertexTextureFormat::RGBAH)
+	{
+		const size_t count = (size_t)m_lockedRect.width * m_lockedRect.height * 4;
+		uint16_t* dst = (uint16_t*)m_stagingData.write().ptr() + m_lockedRect.y * m_width * 4;
+		for (size_t i = 0; i < count; i++)
+		{
+			dst[i] = FloatToHalf(m_lockedRect.ptr[i]);
+		}
+	}
+
+	m_dirtyBegin = std::min(m_dirtyBegin, m_lockedRect.y);
+	m_dirtyEnd = std::max(m_dirtyEnd, m_lockedRect.y + m_lockedRect.height);
+	m_lockedRect = {};
+}
+
+void DynamicTexture::Flush()
+{
+	if (m_dirtyBegin >= m_dirtyEnd)
+	{
+		return;
+	}
+
+	const auto imageFormat = (m_format == VertexTextureFormat::RGBAH) ? 
+		godot::Image::FORMAT_RGBAH : godot::Image::FORMAT_RGBAF;
+	const int32_t texelSize = (m_format == VertexTextureFormat::RGBAH) ? 8 : 16;
+	const int32_t dirtyHeight = m_dirtyEnd - m_dirtyBegin;
+	const size_t rowSize = (size_t)m_width * texelSize;
+
+	// Only the dirty rows are copied, into a new buffer which the (possibly threaded)
+	// visual server may hold on to, so the staging buffer is never shared and copied on write
+	godot::PoolByteArray uploadData;
+	uploadData.resize((int)(rowSize * dirtyHeight));
+	memcpy(uploadData.write().ptr(), m_stagingData.read().ptr() + rowSize * m_dirtyBegin, rowSize * dirtyHeight);
+
 	godot::Ref<godot::Image> image;
 	image.instance();
-	image->create_from_data(m_lockedRect.width, m_lockedRect.height, 
-		false, godot::Image::FORMAT_RGBAF, m_rectData);
+	image->create_from_data(m_width, dirtyHeight, false, imageFormat, uploadData);
 
 	auto vs = godot::VisualServer::get_singleton();
 	vs->texture_set_data_partial(m_imageTexture, image, 
-		0, 0, m_lockedRect.width, m_lockedRect.height, 
-		m_lockedRect.x, m_lockedRect.y, 0, 0);
+		0, 0, m_width, dirtyHeight, 
+		0, m_dirtyBegin, 0, 0);
 
-	m_rectData.resize(0);
-	m_lockedRect = {};
+	m_dirtyBegin = INT32_MAX;
+	m_dirtyEnd = 0;
 }
 
 inline godot::Color ConvertColor(const EffekseerRenderer::VertexColor& color)
@@ -199,6 +291,22 @@ inline godot::Vector2 ConvertVector2(const EffekseerRenderer::VertexFloat3& v)
 	return godot::Vector2(v.X, -v.Y); // invert Y
 }
 
+// Converts a model matrix to a canvas transform when the model's Z axis doesn't move it on screen
+inline bool ToPlanarTransform2D(const Effekseer::Matrix44& m, godot::Transform2D& transform)
+{
+	const float scale = fabsf(m.Values[0][0]) + fabsf(m.Values[0][1]) + fabsf(m.Values[1][0]) + fabsf(m.Values[1][1]);
+	if (fabsf(m.Values[2][0]) + fabsf(m.Values[2][1]) > scale * 1.0e-5f)
+	{
+		return false;
+	}
+
+	// invert Y
+	transform.elements[0] = godot::Vector2(m.Values[0][0], -m.Values[0][1]);
+	transform.elements[1] = godot::Vector2(m.Values[1][0], -m.Values[1][1]);
+	transform.elements[2] = godot::Vector2(m.Values[3][0], -m.Values[3][1]);
+	return true;
+}
+
 inline EffekseerRenderer::VertexFloat3 ConvertPackedVector3(const EffekseerRenderer::VertexColor& v)
 {
 	Effekseer::Vector3D result;
@@ -261,10 +369,154 @@ inline void CopyCustomData(float*& dst, const uint8_t*& src, int32_t count)
 	src += count * sizeof(float);
 }
 
-RenderCommand::RenderCommand()
+struct SimpleMeshVertex
+{
+	float Pos[3];
+	uint8_t Col[4];
+	float UV[2];
+};
+static_assert(sizeof(SimpleMeshVertex) == 24, "Must match the layout of VisualServer surface");
+
+struct FullMeshVertex
+{
+	float Pos[3];
+	float Normal[3];
+	float Tangent[4];
+	uint8_t Col[4];
+	float UV[2];
+	float UV2[2];
+};
+static_assert(sizeof(FullMeshVertex) == 60, "Must match the layout of VisualServer surface");
+
+inline void CopyMeshVertex(SimpleMeshVertex& dst, const EffekseerRenderer::VertexFloat3& pos, 
+	const EffekseerRenderer::VertexColor& col, const float uv[])
+{
+	dst.Pos[0] = pos.X; dst.Pos[1] = pos.Y; dst.Pos[2] = pos.Z;
+	dst.Col[0] = col.R; dst.Col[1] = col.G; dst.Col[2] = col.B; dst.Col[3] = col.A;
+	dst.UV[0] = uv[0]; dst.UV[1] = uv[1];
+}
+
+inline void CopyMeshVertex(FullMeshVertex& dst, const EffekseerRenderer::VertexFloat3& pos, 
+	const EffekseerRenderer::VertexColor& col, const float uv[], 
+	const EffekseerRenderer::VertexColor& normal, const EffekseerRenderer::VertexColor& tangent, 
+	const godot::Vector2& uv2)
+{
+	auto n = Normalize(EffekseerRenderer::UnpackVector3DF(normal));
+	auto t = Normalize(EffekseerRenderer::UnpackVector3DF(tangent));
+	dst.Pos[0] = pos.X; dst.Pos[1] = pos.Y; dst.Pos[2] = pos.Z;
+	dst.Normal[0] = n.X; dst.Normal[1] = n.Y; dst.Normal[2] = n.Z;
+	dst.Tangent[0] = t.X; dst.Tangent[1] = t.Y; dst.Tangent[2] = t.Z; dst.Tangent[3] = 1.0f;
+	dst.Col[0] = col.R; dst.Col[1] = col.G; dst.Col[2] = col.B; dst.Col[3] = col.A;
+	dst.UV[0] = uv[0]; dst.UV[1] = uv[1];
+	dst.UV2[0] = uv2.x; dst.UV2[1] = uv2.y;
+}
+
+DynamicMesh::DynamicMesh()
+{
+}
+
+DynamicMesh::~DynamicMesh()
+{
+	if (m_mesh.is_valid())
+	{
+		auto vs = godot::VisualServer::get_singleton();
+		vs->free_rid(m_mesh);
+	}
+}
+
+int32_t DynamicMesh::GetStride(Layout layout)
+{
+	return (layout == Layout::Simple) ? (int32_t)sizeof(SimpleMeshVertex) : (int32_t)sizeof(FullMeshVertex);
+}
+
+int32_t DynamicMesh::Reserve(Layout layout, int32_t spriteCount)
+{
+	if (spriteCount > m_capacity)
+	{
+		int32_t capacity = std::max(m_capacity, 16);
+		while (capacity < spriteCount) capacity *= 2;
+		Allocate(layout, capacity);
+	}
+
+	// The sprites written last time have to be overwritten too
+	return std::max(spriteCount, m_spriteCount);
+}
+
+void DynamicMesh::Update(const godot::PoolByteArray& vertexData, int32_t spriteCount, const godot::AABB& aabb)
+{
+	auto vs = godot::VisualServer::get_singleton();
+	vs->mesh_surface_update_region(m_mesh, 0, 0, vertexData);
+	vs->mesh_set_custom_aabb(m_mesh, aabb);
+	m_spriteCount = spriteCount;
+	m_aabb = aabb;
+}
+
+void DynamicMesh::Allocate(Layout layout, int32_t capacity)
+{
+	auto vs = godot::VisualServer::get_singleton();
+
+	if (!m_mesh.is_valid())
+	{
+		m_mesh = vs->mesh_create();
+	}
+
+	const int32_t vertexCount = capacity * 4;
+
+	godot::PoolVector3Array positions; positions.resize(vertexCount);
+	godot::PoolColorArray colors; colors.resize(vertexCount);
+	godot::PoolVector2Array texUVs; texUVs.resize(vertexCount);
+	godot::PoolIntArray indeces; indeces.resize(capacity * 6);
+
+	// Quads are drawn as indexed triangles, so the index data never changes
+	{
+		int* indices = indeces.write().ptr();
+
+		for (int32_t i = 0; i < capacity; i++)
+		{
+			indices[i * 6 + 0] = i * 4 + 0;
+			indices[i * 6 + 1] = i * 4 + 1;
+			indices[i * 6 + 2] = i * 4 + 2;
+			indices[i * 6 + 3] = i * 4 + 3;
+			indices[i * 6 + 4] = i * 4 + 2;
+			indices[i * 6 + 5] = i * 4 + 1;
+		}
+	}
+
+	godot::Array arrays;
+	arrays.resize(godot::VisualServer::ARRAY_MAX);
+	arrays[godot::VisualServer::ARRAY_VERTEX] = positions;
+	arrays[godot::VisualServer::ARRAY_COLOR] = colors;
+	arrays[godot::VisualServer::ARRAY_TEX_UV] = texUVs;
+	arrays[godot::VisualServer::ARRAY_INDEX] = indeces;
+
+	if (layout == Layout::Full)
+	{
+		godot::PoolVector3Array normals; normals.resize(vertexCount);
+		godot::PoolRealArray tangents; tangents.resize(vertexCount * 4);
+		godot::PoolVector2Array texUV2s; texUV2s.resize(vertexCount);
+		arrays[godot::VisualServer::ARRAY_NORMAL] = normals;
+		arrays[godot::VisualServer::ARRAY_TANGENT] = tangents;
+		arrays[godot::VisualServer::ARRAY_TEX_UV2] = texUV2s;
+	}
+
+	// Only colors are compressed (to RGBA8), so the interleaved layout matches SimpleMeshVertex/FullMeshVertex
+	vs->mesh_clear(m_mesh);
+	vs->mesh_add_surface_from_arrays(m_mesh, godot::VisualServer::PRIMITIVE_TRIANGLES, 
+		arrays, godot::Array(), godot::VisualServer::ARRAY_COMPRESS_COLOR);
+
+	m_capacity = capacity;
+	// The whole buffer is undefined, so clear it on the next update
+	m_spriteCount = capacity;
+}
+
+RenderCommand::RenderCommand(GeometryUploadMode uploadMode)
+	: m_uploadMode(uploadMode)
 {
 	auto vs = godot::VisualServer::get_singleton();
-	m_immediate = vs->immediate_create();
+	if (uploadMode == GeometryUploadMode::Immediate)
+	{
+		m_immediate = vs->immediate_create();
+	}
 	m_instance = vs->instance_create();
 	m_material = vs->material_create();
 	vs->instance_geometry_set_material_override(m_instance, m_material);
@@ -274,22 +526,32 @@ RenderCommand::~RenderCommand()
 {
 	auto vs = godot::VisualServer::get_singleton();
 	vs->free_rid(m_instance);
-	vs->free_rid(m_immediate);
+	if (m_multimesh.is_valid())
+	{
+		vs->free_rid(m_multimesh);
+	}
+	if (m_immediate.is_valid())
+	{
+		vs->free_rid(m_immediate);
+	}
 	vs->free_rid(m_material);
 }
 
 void RenderCommand::Reset()
 {
 	auto vs = godot::VisualServer::get_singleton();
-	vs->immediate_clear(m_immediate);
+	if (m_uploadMode == GeometryUploadMode::Immediate)
+	{
+		vs->immediate_clear(m_immediate);
+	}
 	vs->instance_set_base(m_instance, godot::RID());
 }
 
-void RenderCommand::DrawSprites(godot::World* world, int32_t priority)
+void RenderCommand::DrawSprites(godot::World* world, godot::RID geometry, int32_t priority)
 {
 	auto vs = godot::VisualServer::get_singleton();
 
-	vs->instance_set_base(m_instance, m_immediate);
+	vs->instance_set_base(m_instance, geometry);
 	vs->instance_set_scenario(m_instance, world->get_scenario());
 	vs->material_set_render_priority(m_material, priority);
 }
@@ -303,6 +565,36 @@ void RenderCommand::DrawModel(godot::World* world, godot::RID mesh, int32_t prio
 	vs->material_set_render_priority(m_material, priority);
 }
 
+void RenderCommand::DrawModelInstances(godot::World* world, godot::RID mesh, const godot::PoolRealArray& instanceData, 
+	int32_t capacity, int32_t instanceCount, int32_t priority)
+{
+	auto vs = godot::VisualServer::get_singleton();
+
+	if (!m_multimesh.is_valid())
+	{
+		m_multimesh = vs->multimesh_create();
+	}
+	if (m_multimeshCapacity != capacity)
+	{
+		vs->multimesh_allocate(m_multimesh, capacity, godot::VisualServer::MULTIMESH_TRANSFORM_3D, 
+			godot::VisualServer::MULTIMESH_COLOR_FLOAT, godot::VisualServer::MULTIMESH_CUSTOM_DATA_FLOAT);
+		m_multimeshCapacity = capacity;
+	}
+	if (m_multimeshMesh != mesh)
+	{
+		vs->multimesh_set_mesh(m_multimesh, mesh);
+		m_multimeshMesh = mesh;
+	}
+
+	// All instances are sent in one call
+	vs->multimesh_set_as_bulk_array(m_multimesh, instanceData);
+	vs->multimesh_set_visible_instances(m_multimesh, instanceCount);
+
+	vs->instance_set_base(m_instance, m_multimesh);
+	vs->instance_set_scenario(m_instance, world->get_scenario());
+	vs->material_set_render_priority(m_material, priority);
+}
+
 EffekseerGodot::RenderCommand2D::RenderCommand2D()
 {
 	auto vs = godot::VisualServer::get_singleton();
@@ -332,21 +624,24 @@ void EffekseerGodot::RenderCommand2D::DrawSprites(godot::RID parentCanvasItem)
 	vs->canvas_item_set_material(m_canvasItem, m_material);
 }
 
-void RenderCommand2D::DrawModel(godot::RID parentCanvasItem, godot::RID mesh)
+void RenderCommand2D::DrawModel(godot::RID parentCanvasItem, godot::RID mesh, const godot::Transform2D& transform)
 {
 	auto vs = godot::VisualServer::get_singleton();
 
 	vs->canvas_item_set_parent(m_canvasItem, parentCanvasItem);
-	vs->canvas_item_add_mesh(m_canvasItem, mesh);
+	vs->canvas_item_add_mesh(m_canvasItem, mesh, transform);
 	vs->canvas_item_set_material(m_canvasItem, m_material);
 }
 
 //----------------------------------------------------------------------------------
 //
 //----------------------------------------------------------------------------------
-RendererRef Renderer::Create(int32_t squareMaxCount, int32_t drawMaxCount)
+RendererRef Renderer::Create(int32_t squareMaxCount, int32_t drawMaxCount, 
+	GeometryUploadMode uploadMode, DrawOverflowPolicy overflowPolicy, 
+	VertexTextureFormat vertexTextureFormat)
 {
-	auto renderer = Effekseer::MakeRefPtr<RendererImplemented>(squareMaxCount);
+	auto renderer = Effekseer::MakeRefPtr<RendererImplemented>(squareMaxCount, 
+		uploadMode, overflowPolicy, vertexTextureFormat);
 	if (renderer->Initialize(drawMaxCount))
 	{
 		return renderer;
@@ -357,8 +652,12 @@ RendererRef Renderer::Create(int32_t squareMaxCount, int32_t drawMaxCount)
 //----------------------------------------------------------------------------------
 //
 //----------------------------------------------------------------------------------
-RendererImplemented::RendererImplemented(int32_t squareMaxCount)
+RendererImplemented::RendererImplemented(int32_t squareMaxCount, GeometryUploadMode uploadMode, 
+	DrawOverflowPolicy overflowPolicy, VertexTextureFormat vertexTextureFormat)
 	: m_squareMaxCount(squareMaxCount)
+	, m_uploadMode(uploadMode)
+	, m_overflowPolicy(overflowPolicy)
+	, m_vertexTextureFormat(vertexTextureFormat)
 {
 	// dummy
 	m_background = Effekseer::MakeRefPtr<Texture>();
@@ -413,14 +712,19 @@ bool RendererImplemented::Initialize(int32_t drawMaxCount)
 		m_shaders[(size_t)RendererShaderType::BackDistortion]->Compile(Shader::RenderType::CanvasItem, Distortion::CanvasItem::code, Distortion::CanvasItem::decl);
 	}
 
-	m_renderCommands.resize((size_t)drawMaxCount);
-	m_renderCommand2Ds.resize((size_t)drawMaxCount);
+	// Commands are allocated on demand up to drawMaxCount
+	const auto uploadMode = m_uploadMode;
+	m_renderCommands.Init((size_t)drawMaxCount, [uploadMode]() {
+		return std::unique_ptr<RenderCommand>(new RenderCommand(uploadMode));
+	});
+	m_renderCommand2Ds.Init((size_t)drawMaxCount, []() {
+		return std::unique_ptr<RenderCommand2D>(new RenderCommand2D());
+	});
 
 	m_standardRenderer.reset(new StandardRenderer(this));
 
-	m_customData1Texture.Init(CUSTOM_DATA_TEXTURE_WIDTH, CUSTOM_DATA_TEXTURE_HEIGHT);
-	m_customData2Texture.Init(CUSTOM_DATA_TEXTURE_WIDTH, CUSTOM_DATA_TEXTURE_HEIGHT);
-	m_uvTangentTexture.Init(CUSTOM_DATA_TEXTURE_WIDTH, CUSTOM_DATA_TEXTURE_HEIGHT);
+	// The first page is always available, more pages are added when it fills up
+	AddVertexTexturePage();
 
 	return true;
 }
@@ -430,25 +734,217 @@ bool RendererImplemented::Initialize(int32_t drawMaxCount)
 //----------------------------------------------------------------------------------
 void RendererImplemented::Destroy()
 {
-	m_renderCommands.clear();
-	m_renderCommand2Ds.clear();
+	m_renderCommands.Clear();
+	m_renderCommand2Ds.Clear();
 }
 
 void RendererImplemented::ResetState()
 {
-	for (size_t i = 0; i < m_renderCount; i++)
+	m_renderCommands.Reset();
+	m_renderCommand2Ds.Reset();
+	m_renderOrder = 0;
+	m_mergeTarget.commandIndex = -1;
+
+	m_vertexTexturePageIndex = 0;
+	m_vertexTextureOffset = 0;
+	m_vertexTextureUsedTexels = 0;
+}
+
+void RendererImplemented::FlushVertexTextures()
+{
+	// Upload the vertex texture rows written in all passes of this frame
+	for (auto& page : m_vertexTexturePages)
 	{
-		m_renderCommands[i].Reset();
+		page->customData1.Flush();
+		page->customData2.Flush();
+		page->uvTangent.Flush();
 	}
-	m_renderCount = 0;
+}
 
-	for (size_t i = 0; i < m_renderCount2D; i++)
+RendererStatistics RendererImplemented::GetStatistics() const
+{
+	RendererStatistics stats;
+	stats.DrawCommandCount = (int32_t)m_renderCommands.GetCount();
+	stats.DrawCommandAllocatedCount = (int32_t)m_renderCommands.GetAllocatedCount();
+	stats.DrawCommandHighWaterMark = (int32_t)m_renderCommands.GetHighWaterMark();
+	stats.DrawCommand2DCount = (int32_t)m_renderCommand2Ds.GetCount();
+	stats.DrawCommand2DAllocatedCount = (int32_t)m_renderCommand2Ds.GetAllocatedCount();
+	stats.DrawCommand2DHighWaterMark = (int32_t)m_renderCommand2Ds.GetHighWaterMark();
+	stats.DroppedDrawCount = m_droppedDrawCount;
+	stats.MergedDrawCount = m_mergedDrawCount;
+	stats.VertexTexturePageCount = (int32_t)m_vertexTexturePages.size();
+	stats.VertexTextureUsedTexels = m_vertexTextureUsedTexels;
+	stats.VertexTextureCapacityTexels = (int32_t)m_vertexTexturePages.size() * VertexTexturePageTexels;
+	stats.VertexTextureOverflowCount = m_vertexTextureOverflowCount;
+	return stats;
+}
+
+void RendererImplemented::AddVertexTexturePage()
+{
+	auto page = std::unique_ptr<VertexTexturePage>(new VertexTexturePage());
+	page->customData1.Init(CUSTOM_DATA_TEXTURE_WIDTH, CUSTOM_DATA_TEXTURE_HEIGHT, m_vertexTextureFormat);
+	page->customData2.Init(CUSTOM_DATA_TEXTURE_WIDTH, CUSTOM_DATA_TEXTURE_HEIGHT, m_vertexTextureFormat);
+	page->uvTangent.Init(CUSTOM_DATA_TEXTURE_WIDTH, CUSTOM_DATA_TEXTURE_HEIGHT, m_vertexTextureFormat);
+	m_vertexTexturePages.push_back(std::move(page));
+}
+
+int32_t RendererImplemented::GetVertexTextureTexelCount(bool is2D, int32_t spriteCount, 
+	const EffekseerRenderer::StandardRendererState& state) const
+{
+	using namespace EffekseerRenderer;
+
+	const auto shaderType = m_currentShader->GetShaderType();
+	const bool required = (is2D) ? 
+		(shaderType == RendererShaderType::Lit || shaderType == RendererShaderType::BackDistortion || shaderType == RendererShaderType::Material) : 
+		(shaderType == RendererShaderType::Material && (state.CustomData1Count > 0 || state.CustomData2Count > 0));
+	if (!required)
 	{
-		m_renderCommand2Ds[i].Reset();
+		return 0;
 	}
-	m_renderCount2D = 0;
 
-	m_vertexTextureOffset = 0;
+	// Each draw starts from the head of a row
+	const int32_t width = CUSTOM_DATA_TEXTURE_WIDTH;
+	return (spriteCount * 4 + width - 1) / width * width;
+}
+
+bool RendererImplemented::FitsInVertexTexturePage(int32_t texelCount) const
+{
+	return m_vertexTextureOffset + texelCount <= VertexTexturePageTexels;
+}
+
+bool RendererImplemented::CanAllocateVertexTexture(int32_t texelCount) const
+{
+	if (texelCount > VertexTexturePageTexels)
+	{
+		return false;
+	}
+
+	// Fits in the current page, or spills into the next (possibly new) page
+	return FitsInVertexTexturePage(texelCount) || 
+		m_vertexTexturePageIndex + 1 < (int32_t)m_vertexTexturePages.size() || 
+		(int32_t)m_vertexTexturePages.size() < VertexTexturePageMaxCount;
+}
+
+void RendererImplemented::AllocateVertexTexture(int32_t texelCount)
+{
+	assert(CanAllocateVertexTexture(texelCount));
+
+	if (!FitsInVertexTexturePage(texelCount))
+	{
+		// Spill into the next page
+		if (m_vertexTexturePageIndex + 1 >= (int32_t)m_vertexTexturePages.size())
+		{
+			AddVertexTexturePage();
+		}
+		m_vertexTexturePageIndex++;
+		m_vertexTextureOffset = 0;
+	}
+
+	m_vertexTextureUsedTexels += texelCount;
+}
+
+void RendererImplemented::BindVertexTextures(godot::RID material, MaterialParamCache& cache, 
+	bool is2D, const EffekseerRenderer::StandardRendererState& state)
+{
+	using namespace EffekseerRenderer;
+
+	auto vs = godot::VisualServer::get_singleton();
+	auto& page = GetVertexTexturePage();
+	const auto shaderType = m_currentShader->GetShaderType();
+
+	// Parameters are set only when the page bound to the material changes
+	if (is2D && (shaderType == RendererShaderType::Lit || shaderType == RendererShaderType::BackDistortion || shaderType == RendererShaderType::Material) && 
+		cache.BindTexture(MaterialTextureSlot_UVTangent, page.uvTangent.GetRID()))
+	{
+		vs->material_set_param(material, "UVTangentTexture", page.uvTangent.GetRID());
+	}
+	if (state.CustomData1Count > 0 && cache.BindTexture(MaterialTextureSlot_CustomData1, page.customData1.GetRID()))
+	{
+		vs->material_set_param(material, "CustomData1", page.customData1.GetRID());
+	}
+	if (state.CustomData2Count > 0 && cache.BindTexture(MaterialTextureSlot_CustomData2, page.customData2.GetRID()))
+	{
+		vs->material_set_param(material, "CustomData2", page.customData2.GetRID());
+	}
+}
+
+template <class T>
+int32_t RendererImplemented::AllocateCommand(RenderCommandPool<T>& pool, int32_t weight)
+{
+	int32_t index = pool.Allocate(weight);
+	if (index < 0)
+	{
+		// Either the lightest draw so far or this draw is dropped
+		index = pool.Evict(weight);
+		m_droppedDrawCount++;
+		if (index == m_mergeTarget.commandIndex)
+		{
+			m_mergeTarget.commandIndex = -1;
+		}
+	}
+	return index;
+}
+
+int32_t RendererImplemented::NextRenderPriority()
+{
+	// Material render priority is limited to the range of int8
+	return std::min(m_renderOrder++, (int32_t)godot::VisualServer::MATERIAL_RENDER_PRIORITY_MAX);
+}
+
+bool RendererImplemented::IsMergeable(godot::Object* node, bool is2D)
+{
+	if (m_overflowPolicy != DrawOverflowPolicy::Merge || m_mergeTarget.commandIndex < 0)
+	{
+		return false;
+	}
+
+	const auto& target = m_mergeTarget;
+	const auto& state = m_renderState->GetActiveState();
+	// Soft particle parameters (and so the render type) are included in the constant buffers
+	if (target.node != node || target.is2D != is2D || target.shader != m_currentShader || 
+		target.vertexTexturePageIndex != m_vertexTexturePageIndex)
+	{
+		return false;
+	}
+
+	if (target.renderState.AlphaBlend != state.AlphaBlend || 
+		target.renderState.CullingType != state.CullingType || 
+		target.renderState.DepthTest != state.DepthTest || 
+		target.renderState.DepthWrite != state.DepthWrite || 
+		target.renderState.TextureIDs != state.TextureIDs || 
+		target.renderState.TextureFilterTypes != state.TextureFilterTypes || 
+		target.renderState.TextureWrapTypes != state.TextureWrapTypes)
+	{
+		return false;
+	}
+
+	const size_t vcbSize = (size_t)m_currentShader->GetVertexConstantBufferSize();
+	const size_t pcbSize = (size_t)m_currentShader->GetPixelConstantBufferSize();
+	return target.constantBuffers.size() == vcbSize + pcbSize && 
+		memcmp(target.constantBuffers.data(), m_currentShader->GetVertexConstantBuffer(), vcbSize) == 0 && 
+		memcmp(target.constantBuffers.data() + vcbSize, m_currentShader->GetPixelConstantBuffer(), pcbSize) == 0;
+}
+
+void RendererImplemented::SetMergeTarget(int32_t commandIndex, godot::Object* node, bool is2D)
+{
+	if (m_overflowPolicy != DrawOverflowPolicy::Merge)
+	{
+		return;
+	}
+
+	auto& target = m_mergeTarget;
+	target.commandIndex = commandIndex;
+	target.node = node;
+	target.is2D = is2D;
+	target.shader = m_currentShader;
+	target.vertexTexturePageIndex = m_vertexTexturePageIndex;
+	target.renderState = m_renderState->GetActiveState();
+
+	const size_t vcbSize = (size_t)m_currentShader->GetVertexConstantBufferSize();
+	const size_t pcbSize = (size_t)m_currentShader->GetPixelConstantBufferSize();
+	target.constantBuffers.resize(vcbSize + pcbSize);
+	memcpy(target.constantBuffers.data(), m_currentShader->GetVertexConstantBuffer(), vcbSize);
+	memcpy(target.constantBuffers.data() + vcbSize, m_currentShader->GetPixelConstantBuffer(), pcbSize);
 }
 
 //----------------------------------------------------------------------------------
@@ -574,6 +1070,16 @@ void RendererImplemented::SetLayout(Shader* shader)
 {
 }
 
+// 3D handles have their emitter as user data, warm-up handles of preload have the world itself
+static godot::World* GetUserDataWorld(godot::Object* godotObj)
+{
+	if (auto node3d = godot::Object::cast_to<godot::Spatial>(godotObj))
+	{
+		return node3d->get_world().ptr();
+	}
+	return godot::Object::cast_to<godot::World>(godotObj);
+}
+
 //----------------------------------------------------------------------------------
 //
 //----------------------------------------------------------------------------------
@@ -586,64 +1092,103 @@ void RendererImplemented::DrawSprites(int32_t spriteCount, int32_t vertexOffset)
 	const auto& state = m_standardRenderer->GetState();
 	godot::Object* godotObj = reinterpret_cast<godot::Object*>(GetImpl()->CurrentHandleUserData);
 	
-	if (auto node3d = godot::Object::cast_to<godot::Spatial>(godotObj)) {
-		if (m_renderCount >= m_renderCommands.size()) return;
-
+	if (auto world = GetUserDataWorld(godotObj)) {
 		const bool softparticleEnabled = !(
 			state.SoftParticleDistanceFar == 0.0f &&
 			state.SoftParticleDistanceNear == 0.0f &&
 			state.SoftParticleDistanceNearOffset == 0.0f);
 		const Shader::RenderType renderType = (softparticleEnabled) ? 
 			Shader::RenderType::SpatialDepthFade : Shader::RenderType::SpatialLightweight;
+		const auto layout = (m_currentShader->GetShaderType() == EffekseerRenderer::RendererShaderType::Unlit) ? 
+			DynamicMesh::Layout::Simple : DynamicMesh::Layout::Full;
+
+		// The draw is dropped if the vertex texture space does not fit, counted as an overflow only
+		const int32_t texelCount = GetVertexTextureTexelCount(false, spriteCount, state);
+		if (texelCount > 0 && !CanAllocateVertexTexture(texelCount))
+		{
+			m_vertexTextureOverflowCount++;
+			return;
+		}
 
-		auto& command = m_renderCommands[m_renderCount];
+		// When the commands run out, append to the last command if it is compatible
+		const bool merging = m_renderCommands.IsFull() && IsMergeable(godotObj, false) && 
+			(texelCount == 0 || FitsInVertexTexturePage(texelCount));
+		const int32_t commandIndex = (merging) ? m_mergeTarget.commandIndex : AllocateCommand(m_renderCommands, spriteCount);
+		if (commandIndex < 0) return;
 
-		// Transfer vertex data
-		TransferVertexToImmediate3D(command.GetImmediate(), GetVertexBuffer()->Refer(), spriteCount, state);
+		// Reserved only once the draw has a command
+		if (texelCount > 0) AllocateVertexTexture(texelCount);
 
-		// Setup material
-		m_currentShader->ApplyToMaterial(renderType, command.GetMaterial(), m_renderState->GetActiveState());
+		auto& command = m_renderCommands[commandIndex];
 
-		if (state.CustomData1Count > 0)
+		// Transfer vertex data
+		godot::RID geometry;
+		if (command.GetUploadMode() == GeometryUploadMode::Immediate)
+		{
+			geometry = command.GetImmediate();
+			TransferVertexToImmediate3D(geometry, GetVertexBuffer()->Refer(), spriteCount, state);
+		}
+		else
 		{
-			vs->material_set_param(command.GetMaterial(), "CustomData1", m_customData1Texture.GetRID());
+			auto& mesh = command.GetDynamicMesh(layout);
+			const int32_t spriteOffset = (merging) ? mesh.GetSpriteCount() : 0;
+			TransferVertexToMesh3D(mesh, layout, GetVertexBuffer()->Refer(), spriteCount, state, spriteOffset);
+			geometry = mesh.GetRID();
 		}
-		if (state.CustomData2Count > 0)
+
+		if (merging)
 		{
-			vs->material_set_param(command.GetMaterial(), "CustomData2", m_customData2Texture.GetRID());
+			m_renderCommands.AddWeight(commandIndex, spriteCount);
+			m_mergedDrawCount++;
+			impl->drawvertexCount += spriteCount * 4;
+			return;
 		}
 
-		command.DrawSprites(node3d->get_world().ptr(), (int32_t)m_renderCount);
-		m_renderCount++;
+		// Setup material
+		m_currentShader->ApplyToMaterial(renderType, command.GetMaterial(), command.GetMaterialCache(), m_renderState->GetActiveState());
+
+		BindVertexTextures(command.GetMaterial(), command.GetMaterialCache(), false, state);
+
+		command.DrawSprites(world, geometry, NextRenderPriority());
+		SetMergeTarget(commandIndex, godotObj, false);
 
 	} else if (auto node2d = godot::Object::cast_to<godot::Node2D>(godotObj)) {
-		if (m_renderCount2D >= m_renderCommand2Ds.size()) return;
+		// The draw is dropped if the vertex texture space does not fit, counted as an overflow only
+		const int32_t texelCount = GetVertexTextureTexelCount(true, spriteCount, state);
+		if (texelCount > 0 && !CanAllocateVertexTexture(texelCount))
+		{
+			m_vertexTextureOverflowCount++;
+			return;
+		}
+
+		const bool merging = m_renderCommand2Ds.IsFull() && IsMergeable(godotObj, true) && 
+			(texelCount == 0 || FitsInVertexTexturePage(texelCount));
+		const int32_t commandIndex = (merging) ? m_mergeTarget.commandIndex : AllocateCommand(m_renderCommand2Ds, spriteCount);
+		if (commandIndex < 0) return;
 
-		auto& command = m_renderCommand2Ds[m_renderCount2D];
+		// Reserved only once the draw has a command
+		if (texelCount > 0) AllocateVertexTexture(texelCount);
+
+		auto& command = m_renderCommand2Ds[commandIndex];
 
 		// Transfer vertex data
 		TransferVertexToCanvasItem2D(command.GetCanvasItem(), GetVertexBuffer()->Refer(), spriteCount, state);
 
-		// Setup material
-		m_currentShader->ApplyToMaterial(Shader::RenderType::CanvasItem, command.GetMaterial(), m_renderState->GetActiveState());
-
-		if (m_currentShader->GetShaderType() == EffekseerRenderer::RendererShaderType::Lit || 
-			m_currentShader->GetShaderType() == EffekseerRenderer::RendererShaderType::BackDistortion ||
-			m_currentShader->GetShaderType() == EffekseerRenderer::RendererShaderType::Material)
+		if (merging)
 		{
-			vs->material_set_param(command.GetMaterial(), "UVTangentTexture", m_uvTangentTexture.GetRID());
-		}
-		if (state.CustomData1Count > 0)
-		{
-			vs->material_set_param(command.GetMaterial(), "CustomData1", m_customData1Texture.GetRID());
-		}
-		if (state.CustomData2Count > 0)
-		{
-			vs->material_set_param(command.GetMaterial(), "CustomData2", m_customData2Texture.GetRID());
+			m_renderCommand2Ds.AddWeight(commandIndex, spriteCount);
+			m_mergedDrawCount++;
+			impl->drawvertexCount += spriteCount * 4;
+			return;
 		}
 
+		// Setup material
+		m_currentShader->ApplyToMaterial(Shader::RenderType::CanvasItem, command.GetMaterial(), command.GetMaterialCache(), m_renderState->GetActiveState());
+
+		BindVertexTextures(command.GetMaterial(), command.GetMaterialCache(), true, state);
+
 		command.DrawSprites(node2d->get_canvas_item());
-		m_renderCount2D++;
+		SetMergeTarget(commandIndex, godotObj, true);
 	}
 
 	impl->drawcallCount++;
@@ -671,8 +1216,12 @@ void RendererImplemented::DrawPolygon(int32_t vertexCount, int32_t indexCount)
 	const auto& state = m_standardRenderer->GetState();
 	godot::Object* godotObj = reinterpret_cast<godot::Object*>(GetImpl()->CurrentHandleUserData);
 
-	if (auto node3d = godot::Object::cast_to<godot::Spatial>(godotObj)) {
-		if (m_renderCount >= m_renderCommands.size()) return;
+	// Models are weighted by the equivalent number of sprites
+	const int32_t weight = (vertexCount + 3) / 4;
+
+	if (auto world = GetUserDataWorld(godotObj)) {
+		const int32_t commandIndex = AllocateCommand(m_renderCommands, weight);
+		if (commandIndex < 0) return;
 
 		const bool softparticleEnabled = !(
 			state.SoftParticleDistanceFar == 0.0f &&
@@ -681,30 +1230,42 @@ void RendererImplemented::DrawPolygon(int32_t vertexCount, int32_t indexCount)
 		const Shader::RenderType renderType = (softparticleEnabled) ? 
 			Shader::RenderType::SpatialDepthFade : Shader::RenderType::SpatialLightweight;
 
-		auto& command = m_renderCommands[m_renderCount];
+		auto& command = m_renderCommands[commandIndex];
 
 		// Setup material
-		m_currentShader->ApplyToMaterial(renderType, command.GetMaterial(), m_renderState->GetActiveState());
+		m_currentShader->ApplyToMaterial(renderType, command.GetMaterial(), command.GetMaterialCache(), m_renderState->GetActiveState());
 
 		auto mesh = m_currentModel.DownCast<Model>()->GetRID();
-		command.DrawModel(node3d->get_world().ptr(), mesh, (int32_t)m_renderCount);
-		m_renderCount++;
+		command.DrawModel(world, mesh, NextRenderPriority());
+		m_mergeTarget.commandIndex = -1;
 
 	} else if (auto node2d = godot::Object::cast_to<godot::Node2D>(godotObj)) {
-		if (m_renderCount2D >= m_renderCommand2Ds.size()) return;
+		const int32_t commandIndex = AllocateCommand(m_renderCommand2Ds, weight);
+		if (commandIndex < 0) return;
 
-		auto& command = m_renderCommand2Ds[m_renderCount2D];
+		auto& command = m_renderCommand2Ds[commandIndex];
 
-		// Transfer vertex data
-		TransferModelToCanvasItem2D(command.GetCanvasItem(), m_currentModel.Get(), state);
-		
 		// Setup material
-		m_currentShader->ApplyToMaterial(Shader::RenderType::CanvasItem, command.GetMaterial(), m_renderState->GetActiveState());
+		m_currentShader->ApplyToMaterial(Shader::RenderType::CanvasItem, command.GetMaterial(), command.GetMaterialCache(), m_renderState->GetActiveState());
 
-		//auto mesh = m_currentModel.DownCast<Model>()->GetRID();
-		//command.DrawModel(node2d->get_canvas_item(), mesh);
-		command.DrawSprites(node2d->get_canvas_item());
-		m_renderCount2D++;
+		const uint8_t* constantBuffer = (const uint8_t*)m_currentShader->GetVertexConstantBuffer();
+		const auto& worldMatrix = *(const Effekseer::Matrix44*)(constantBuffer + GetModelMatrixOffset(1, 0));
+
+		godot::Transform2D transform;
+		if (m_currentShader->GetShaderType() != EffekseerRenderer::RendererShaderType::Material && 
+			state.CullingType == Effekseer::CullingType::Double && ToPlanarTransform2D(worldMatrix, transform))
+		{
+			// Draw the model's own mesh, canvas items are always double-sided
+			auto mesh = m_currentModel.DownCast<Model>()->GetRID();
+			command.DrawModel(node2d->get_canvas_item(), mesh, transform);
+		}
+		else
+		{
+			// Transform and cull the vertices on the CPU
+			TransferModelToCanvasItem2D(command.GetCanvasItem(), m_currentModel.Get(), state);
+			command.DrawSprites(node2d->get_canvas_item());
+		}
+		m_mergeTarget.commandIndex = -1;
 	}
 
 	impl->drawcallCount++;
@@ -713,9 +1274,114 @@ void RendererImplemented::DrawPolygon(int32_t vertexCount, int32_t indexCount)
 
 void RendererImplemented::DrawPolygonInstanced(int32_t vertexCount, int32_t indexCount, int32_t instanceCount)
 {
+	assert(m_currentShader != nullptr);
 	assert(m_currentModel != nullptr);
-	impl->drawcallCount++;
-	impl->drawvertexCount += vertexCount * instanceCount;
+
+	if (m_currentShader->GetInstanceCount() <= 1)
+	{
+		// The constant buffer holds a single model, so a batch of more models could not have been
+		// written into it (SetVertexBufferToShader asserts the size)
+		assert(instanceCount <= 1);
+		DrawPolygon(vertexCount, indexCount);
+		return;
+	}
+
+	const auto& state = m_standardRenderer->GetState();
+	godot::Object* godotObj = reinterpret_cast<godot::Object*>(GetImpl()->CurrentHandleUserData);
+
+	if (auto world = GetUserDataWorld(godotObj)) {
+		const int32_t commandIndex = AllocateCommand(m_renderCommands, (vertexCount + 3) / 4 * instanceCount);
+		if (commandIndex < 0) return;
+
+		const bool softparticleEnabled = !(
+			state.SoftParticleDistanceFar == 0.0f &&
+			state.SoftParticleDistanceNear == 0.0f &&
+			state.SoftParticleDistanceNearOffset == 0.0f);
+		const Shader::RenderType renderType = (softparticleEnabled) ? 
+			Shader::RenderType::SpatialDepthFadeInstanced : Shader::RenderType::SpatialLightweightInstanced;
+
+		auto& command = m_renderCommands[commandIndex];
+
+		// Setup material
+		m_currentShader->ApplyToMaterial(renderType, command.GetMaterial(), command.GetMaterialCache(), m_renderState->GetActiveState());
+
+		// Transfer instance data
+		TransferModelInstances(instanceCount);
+
+		auto mesh = m_currentModel.DownCast<Model>()->GetRID();
+		command.DrawModelInstances(world, mesh, m_modelInstanceData, 
+			m_currentShader->GetInstanceCount(), instanceCount, NextRenderPriority());
+		m_mergeTarget.commandIndex = -1;
+
+		impl->drawcallCount++;
+		impl->drawvertexCount += vertexCount * instanceCount;
+
+	} else if (godot::Object::cast_to<godot::Node2D>(godotObj)) {
+		// Canvas items have no instancing
+		DrawModelsPerInstance(vertexCount, indexCount, instanceCount);
+	}
+}
+
+void RendererImplemented::TransferModelInstances(int32_t instanceCount)
+{
+	const int32_t batchCount = m_currentShader->GetInstanceCount();
+	const uint8_t* constantBuffer = (const uint8_t*)m_currentShader->GetVertexConstantBuffer();
+
+	if (m_modelInstanceData.size() != batchCount * ModelInstanceStride)
+	{
+		m_modelInstanceData.resize(batchCount * ModelInstanceStride);
+	}
+
+	float* instances = m_modelInstanceData.write().ptr();
+	float* dst = instances;
+	for (int32_t i = 0; i < batchCount; i++, dst += ModelInstanceStride)
+	{
+		if (i < instanceCount)
+		{
+			auto transform = ToGdMatrix(*(const Effekseer::Matrix44*)(constantBuffer + GetModelMatrixOffset(batchCount, i)));
+			for (int32_t row = 0; row < 3; row++)
+			{
+				dst[row * 4 + 0] = transform.basis[row][0];
+				dst[row * 4 + 1] = transform.basis[row][1];
+				dst[row * 4 + 2] = transform.basis[row][2];
+				dst[row * 4 + 3] = transform.origin[row];
+			}
+			memcpy(&dst[12], constantBuffer + GetModelColorOffset(batchCount, i), sizeof(float) * 4);
+			memcpy(&dst[16], constantBuffer + GetModelUVOffset(batchCount, i), sizeof(float) * 4);
+		}
+		else
+		{
+			// Unused instances are collapsed onto the first one to keep the bounds tight
+			memset(dst, 0, sizeof(float) * ModelInstanceStride);
+			dst[3] = instances[3];
+			dst[7] = instances[7];
+			dst[11] = instances[11];
+		}
+	}
+}
+
+void RendererImplemented::DrawModelsPerInstance(int32_t vertexCount, int32_t indexCount, int32_t instanceCount)
+{
+	const int32_t batchCount = m_currentShader->GetInstanceCount();
+	uint8_t* constantBuffer = (uint8_t*)m_currentShader->GetVertexConstantBuffer();
+	const size_t constantBufferSize = (size_t)m_currentShader->GetVertexConstantBufferSize();
+
+	m_modelBatchConstants.assign(constantBuffer, constantBuffer + constantBufferSize);
+	const uint8_t* batch = m_modelBatchConstants.data();
+
+	// Rewrite the constant buffer into the single model layout
+	memcpy(constantBuffer + GetModelTrailerOffset(1), batch + GetModelTrailerOffset(batchCount), 
+		constantBufferSize - GetModelTrailerOffset(batchCount));
+
+	for (int32_t i = 0; i < instanceCount; i++)
+	{
+		memcpy(constantBuffer + GetModelMatrixOffset(1, 0), batch + GetModelMatrixOffset(batchCount, i), sizeof(Effekseer::Matrix44));
+		memcpy(constantBuffer + GetModelUVOffset(1, 0), batch + GetModelUVOffset(batchCount, i), sizeof(float) * 4);
+		memcpy(constantBuffer + GetModelColorOffset(1, 0), batch + GetModelColorOffset(batchCount, i), sizeof(float) * 4);
+		DrawPolygon(vertexCount, indexCount);
+	}
+
+	memcpy(constantBuffer, batch, constantBufferSize);
 }
 
 Shader* RendererImplemented::GetShader(::EffekseerRenderer::RendererShaderType type)
@@ -863,11 +1529,12 @@ void RendererImplemented::TransferVertexToImmediate3D(godot::RID immediate,
 
 		if (customData1Count > 0 || customData2Count > 0)
 		{
+			auto& page = GetVertexTexturePage();
 			const int32_t width = CUSTOM_DATA_TEXTURE_WIDTH;
 			const int32_t height = (spriteCount * 4 + width - 1) / width;
 			const uint8_t* vertexPtr = (const uint8_t*)vertexData;
-			float* customData1TexPtr = (customData1Count > 0) ? m_customData1Texture.Lock(0, m_vertexTextureOffset / width, width, height)->ptr : nullptr;
-			float* customData2TexPtr = (customData2Count > 0) ? m_customData2Texture.Lock(0, m_vertexTextureOffset / width, width, height)->ptr : nullptr;
+			float* customData1TexPtr = (customData1Count > 0) ? page.customData1.Lock(0, m_vertexTextureOffset / width, width, height)->ptr : nullptr;
+			float* customData2TexPtr = (customData2Count > 0) ? page.customData2.Lock(0, m_vertexTextureOffset / width, width, height)->ptr : nullptr;
 			
 			for (int32_t i = 0; i < spriteCount; i++)
 			{
@@ -902,8 +1569,8 @@ void RendererImplemented::TransferVertexToImmediate3D(godot::RID immediate,
 				vs->immediate_vertex(immediate, ConvertVector3((*(const DynamicVertex*)(vertexPtr - stride)).Pos));
 			}
 
-			if (customData1TexPtr) m_customData1Texture.Unlock();
-			if (customData2TexPtr) m_customData2Texture.Unlock();
+			if (customData1TexPtr) page.customData1.Unlock();
+			if (customData2TexPtr) page.customData2.Unlock();
 			m_vertexTextureOffset = (m_vertexTextureOffset + width - 1) / width * width;
 		}
 		else
@@ -941,38 +1608,121 @@ void RendererImplemented::TransferVertexToImmediate3D(godot::RID immediate,
 	vs->immediate_end(immediate);
 }
 
-void RendererImplemented::TransferVertexToCanvasItem2D(godot::RID canvas_item, 
-	const void* vertexData, int32_t spriteCount, 
-	const EffekseerRenderer::StandardRendererState& state)
+void RendererImplemented::TransferVertexToMesh3D(DynamicMesh& mesh, DynamicMesh::Layout layout, 
+	const void* vertexData, int32_t spriteCount, const EffekseerRenderer::StandardRendererState& state, int32_t spriteOffset)
 {
 	using namespace EffekseerRenderer;
 
-	auto vs = godot::VisualServer::get_singleton();
+	// When appending, the staging buffer still holds the sprites of the previous transfer
+	const int32_t stride = DynamicMesh::GetStride(layout);
+	const int32_t totalCount = spriteOffset + spriteCount;
+	const int32_t uploadCount = mesh.Reserve(layout, totalCount);
 
-	godot::PoolIntArray indexArray;
-	godot::PoolVector2Array pointArray;
-	godot::PoolColorArray colorArray;
-	godot::PoolVector2Array uvArray;
+	m_meshStaging.resize(uploadCount * 4 * stride);
+	uint8_t* dstPtr = m_meshStaging.write().ptr() + spriteOffset * 4 * stride;
+
+	godot::Vector3 aabbMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	godot::Vector3 aabbMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	if (spriteOffset > 0)
+	{
+		aabbMin = mesh.GetAABB().position;
+		aabbMax = mesh.GetAABB().position + mesh.GetAABB().size;
+	}
+	auto expandBounds = [&](const EffekseerRenderer::VertexFloat3& pos)
+	{
+		aabbMin.x = std::min(aabbMin.x, pos.X); aabbMax.x = std::max(aabbMax.x, pos.X);
+		aabbMin.y = std::min(aabbMin.y, pos.Y); aabbMax.y = std::max(aabbMax.y, pos.Y);
+		aabbMin.z = std::min(aabbMin.z, pos.Z); aabbMax.z = std::max(aabbMax.z, pos.Z);
+	};
 
-	indexArray.resize(spriteCount * 6);
-	pointArray.resize(spriteCount * 4);
-	colorArray.resize(spriteCount * 4);
-	uvArray.resize(spriteCount * 4);
+	RendererShaderType shaderType = m_currentShader->GetShaderType();
 
-	// Generate index data
+	// Copy vertex data
+	if (shaderType == RendererShaderType::Unlit)
 	{
-		int* indices = indexArray.write().ptr();
+		assert(layout == DynamicMesh::Layout::Simple);
 
-		for (int32_t i = 0; i < spriteCount; i++)
+		SimpleMeshVertex* dst = (SimpleMeshVertex*)dstPtr;
+		const SimpleVertex* vertices = (const SimpleVertex*)vertexData;
+		for (int32_t i = 0; i < spriteCount * 4; i++)
 		{
-			indices[i * 6 + 0] = i * 4 + 0;
-			indices[i * 6 + 1] = i * 4 + 1;
-			indices[i * 6 + 2] = i * 4 + 2;
-			indices[i * 6 + 3] = i * 4 + 3;
-			indices[i * 6 + 4] = i * 4 + 2;
-			indices[i * 6 + 5] = i * 4 + 1;
+			auto& v = vertices[i];
+			CopyMeshVertex(dst[i], v.Pos, v.Col, v.UV);
+			expandBounds(v.Pos);
+		}
+	}
+	else if (shaderType == RendererShaderType::BackDistortion || shaderType == RendererShaderType::Lit)
+	{
+		assert(layout == DynamicMesh::Layout::Full);
+
+		FullMeshVertex* dst = (FullMeshVertex*)dstPtr;
+		const LightingVertex* vertices = (const LightingVertex*)vertexData;
+		for (int32_t i = 0; i < spriteCount * 4; i++)
+		{
+			auto& v = vertices[i];
+			CopyMeshVertex(dst[i], v.Pos, v.Col, v.UV, v.Normal, v.Tangent, godot::Vector2());
+			expandBounds(v.Pos);
 		}
 	}
+	else if (shaderType == RendererShaderType::Material)
+	{
+		assert(layout == DynamicMesh::Layout::Full);
+
+		const int32_t customData1Count = state.CustomData1Count;
+		const int32_t customData2Count = state.CustomData2Count;
+		const bool hasCustomData = customData1Count > 0 || customData2Count > 0;
+
+		auto& page = GetVertexTexturePage();
+		const int32_t width = CUSTOM_DATA_TEXTURE_WIDTH;
+		const int32_t height = (spriteCount * 4 + width - 1) / width;
+		const uint8_t* vertexPtr = (const uint8_t*)vertexData;
+		float* customData1TexPtr = (customData1Count > 0) ? page.customData1.Lock(0, m_vertexTextureOffset / width, width, height)->ptr : nullptr;
+		float* customData2TexPtr = (customData2Count > 0) ? page.customData2.Lock(0, m_vertexTextureOffset / width, width, height)->ptr : nullptr;
+
+		FullMeshVertex* dst = (FullMeshVertex*)dstPtr;
+		for (int32_t i = 0; i < spriteCount * 4; i++)
+		{
+			auto& v = *(const DynamicVertex*)vertexPtr;
+			godot::Vector2 uv2 = (hasCustomData) ? ConvertVertexTextureUV(m_vertexTextureOffset++, width) : godot::Vector2();
+			CopyMeshVertex(dst[i], v.Pos, v.Col, v.UV, v.Normal, v.Tangent, uv2);
+			expandBounds(v.Pos);
+			vertexPtr += sizeof(DynamicVertex);
+
+			if (customData1TexPtr) CopyCustomData(customData1TexPtr, vertexPtr, customData1Count);
+			if (customData2TexPtr) CopyCustomData(customData2TexPtr, vertexPtr, customData2Count);
+		}
+
+		if (customData1TexPtr) page.customData1.Unlock();
+		if (customData2TexPtr) page.customData2.Unlock();
+		if (hasCustomData)
+		{
+			m_vertexTextureOffset = (m_vertexTextureOffset + width - 1) / width * width;
+		}
+	}
+
+	// Collapse sprites left over from the previous frame into degenerate triangles
+	if (uploadCount > totalCount)
+	{
+		memset(dstPtr + spriteCount * 4 * stride, 0, (uploadCount - totalCount) * 4 * stride);
+	}
+
+	mesh.Update(m_meshStaging, totalCount, godot::AABB(aabbMin, aabbMax - aabbMin));
+}
+
+void RendererImplemented::TransferVertexToCanvasItem2D(godot::RID canvas_item, 
+	const void* vertexData, int32_t spriteCount, 
+	const EffekseerRenderer::StandardRendererState& state)
+{
+	using namespace EffekseerRenderer;
+
+	auto vs = godot::VisualServer::get_singleton();
+
+	// Arrays are reused, only the first spriteCount quads are drawn
+	auto& scratch = GetCanvasScratch(spriteCount);
+	auto& indexArray = scratch.indices;
+	auto& pointArray = scratch.points;
+	auto& colorArray = scratch.colors;
+	auto& uvArray = scratch.uvs;
 
 	RendererShaderType shaderType = m_currentShader->GetShaderType();
 
@@ -1001,9 +1751,10 @@ void RendererImplemented::TransferVertexToCanvasItem2D(godot::RID canvas_item,
 		godot::Color* colors = colorArray.write().ptr();
 		godot::Vector2* uvs = uvArray.write().ptr();
 
+		auto& page = GetVertexTexturePage();
 		const int32_t width = CUSTOM_DATA_TEXTURE_WIDTH;
 		const int32_t height = (spriteCount * 4 + width - 1) / width;
-		float* uvtTexPtr = m_uvTangentTexture.Lock(0, m_vertexTextureOffset / width, width, height)->ptr;
+		float* uvtTexPtr = page.uvTangent.Lock(0, m_vertexTextureOffset / width, width, height)->ptr;
 
 		const LightingVertex* vertices = (const LightingVertex*)vertexData;
 		for (int32_t i = 0; i < spriteCount; i++)
@@ -1020,7 +1771,7 @@ void RendererImplemented::TransferVertexToCanvasItem2D(godot::RID canvas_item,
 			}
 		}
 
-		m_uvTangentTexture.Unlock();
+		page.uvTangent.Unlock();
 		m_vertexTextureOffset = (m_vertexTextureOffset + width - 1) / width * width;
 	}
 	else if (shaderType == RendererShaderType::Material)
@@ -1033,12 +1784,13 @@ void RendererImplemented::TransferVertexToCanvasItem2D(godot::RID canvas_item,
 		godot::Color* colors = colorArray.write().ptr();
 		godot::Vector2* uvs = uvArray.write().ptr();
 
+		auto& page = GetVertexTexturePage();
 		const int32_t width = CUSTOM_DATA_TEXTURE_WIDTH;
 		const int32_t height = (spriteCount * 4 + width - 1) / width;
 		const uint8_t* vertexPtr = (const uint8_t*)vertexData;
-		float* uvtTexPtr = m_uvTangentTexture.Lock(0, m_vertexTextureOffset / width, width, height)->ptr;
-		float* customData1TexPtr = (customData1Count > 0) ? m_customData1Texture.Lock(0, m_vertexTextureOffset / width, width, height)->ptr : nullptr;
-		float* customData2TexPtr = (customData2Count > 0) ? m_customData2Texture.Lock(0, m_vertexTextureOffset / width, width, height)->ptr : nullptr;
+		float* uvtTexPtr = page.uvTangent.Lock(0, m_vertexTextureOffset / width, width, height)->ptr;
+		float* customData1TexPtr = (customData1Count > 0) ? page.customData1.Lock(0, m_vertexTextureOffset / width, width, height)->ptr : nullptr;
+		float* customData2TexPtr = (customData2Count > 0) ? page.customData2.Lock(0, m_vertexTextureOffset / width, width, height)->ptr : nullptr;
 
 		for (int32_t i = 0; i < spriteCount; i++)
 		{
@@ -1058,13 +1810,64 @@ void RendererImplemented::TransferVertexToCanvasItem2D(godot::RID canvas_item,
 			}
 		}
 
-		m_uvTangentTexture.Unlock();
-		if (customData1TexPtr) m_customData1Texture.Unlock();
-		if (customData2TexPtr) m_customData2Texture.Unlock();
+		page.uvTangent.Unlock();
+		if (customData1TexPtr) page.customData1.Unlock();
+		if (customData2TexPtr) page.customData2.Unlock();
 		m_vertexTextureOffset = (m_vertexTextureOffset + width - 1) / width * width;
 	}
 
-	vs->canvas_item_add_triangle_array(canvas_item, indexArray, pointArray, colorArray, uvArray);
+	// Collapse the unused vertices to keep the bounds of the canvas item tight
+	{
+		godot::Vector2* points = pointArray.write().ptr();
+		for (int32_t i = spriteCount * 4; i < scratch.capacity * 4; i++)
+		{
+			points[i] = points[0];
+		}
+	}
+
+	// The count is in triangles, two per quad
+	vs->canvas_item_add_triangle_array(canvas_item, indexArray, pointArray, colorArray, uvArray, 
+		godot::PoolIntArray(), godot::PoolRealArray(), godot::RID(), spriteCount * 2);
+}
+
+RendererImplemented::CanvasScratch& RendererImplemented::GetCanvasScratch(int32_t spriteCount)
+{
+	// Buffers are kept per power of two size, so at most twice the vertices are sent
+	size_t sizeClass = 0;
+	int32_t capacity = CanvasScratchMinSprites;
+	while (capacity < spriteCount)
+	{
+		capacity *= 2;
+		sizeClass++;
+	}
+
+	if (sizeClass >= m_canvasScratches.size())
+	{
+		m_canvasScratches.resize(sizeClass + 1);
+	}
+
+	auto& scratch = m_canvasScratches[sizeClass];
+	if (scratch.capacity == 0)
+	{
+		scratch.capacity = capacity;
+		scratch.indices.resize(capacity * 6);
+		scratch.points.resize(capacity * 4);
+		scratch.colors.resize(capacity * 4);
+		scratch.uvs.resize(capacity * 4);
+
+		// The quad index pattern never changes
+		int* indices = scratch.indices.write().ptr();
+		for (int32_t i = 0; i < capacity; i++)
+		{
+			indices[i * 6 + 0] = i * 4 + 0;
+			indices[i * 6 + 1] = i * 4 + 1;
+			indices[i * 6 + 2] = i * 4 + 2;
+			indices[i * 6 + 3] = i * 4 + 3;
+			indices[i * 6 + 4] = i * 4 + 2;
+			indices[i * 6 + 5] = i * 4 + 1;
+		}
+	}
+	return scratch;
 }
 
 void RendererImplemented::TransferModelToCanvasItem2D(godot::RID canvas_item, 
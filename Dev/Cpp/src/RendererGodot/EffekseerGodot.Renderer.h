@@ -19,6 +19,52 @@ namespace EffekseerGodot
 class Renderer;
 using RendererRef = Effekseer::RefPtr<Renderer>;
 
+/**
+	@brief	3D描画の頂点転送方式
+*/
+enum class GeometryUploadMode : int32_t
+{
+	Mesh,
+	Immediate,
+};
+
+/**
+	@brief	頂点テクスチャのフォーマット
+*/
+enum class VertexTextureFormat : int32_t
+{
+	RGBAF,
+	RGBAH,
+};
+
+/**
+	@brief	描画コマンド数が上限に達した時の処理
+*/
+enum class DrawOverflowPolicy : int32_t
+{
+	DropLowestPriority,
+	Merge,
+};
+
+/**
+	@brief	描画の統計情報
+*/
+struct RendererStatistics
+{
+	int32_t DrawCommandCount = 0;
+	int32_t DrawCommandAllocatedCount = 0;
+	int32_t DrawCommandHighWaterMark = 0;
+	int32_t DrawCommand2DCount = 0;
+	int32_t DrawCommand2DAllocatedCount = 0;
+	int32_t DrawCommand2DHighWaterMark = 0;
+	int64_t DroppedDrawCount = 0;
+	int64_t MergedDrawCount = 0;
+	int32_t VertexTexturePageCount = 0;
+	int32_t VertexTextureUsedTexels = 0;
+	int32_t VertexTextureCapacityTexels = 0;
+	int64_t VertexTextureOverflowCount = 0;
+};
+
 /**
 	@brief	描画クラス
 */
@@ -36,14 +82,30 @@ public:
 	/**
 		@brief	インスタンスを生成する。
 		@param	squareMaxCount	最大描画スプライト数
+		@param	drawMaxCount	最大描画コマンド数
+		@param	uploadMode	3D描画の頂点転送方式
+		@param	overflowPolicy	描画コマンド数が上限に達した時の処理
+		@param	vertexTextureFormat	頂点テクスチャのフォーマット
 		@return	インスタンス
 	*/
-	static RendererRef Create(int32_t squareMaxCount, int32_t drawMaxCount);
+	static RendererRef Create(int32_t squareMaxCount, int32_t drawMaxCount, 
+		GeometryUploadMode uploadMode, DrawOverflowPolicy overflowPolicy, 
+		VertexTextureFormat vertexTextureFormat);
 
 	/**
 		@brief	状態リセット
 	*/
 	virtual void ResetState() = 0;
+
+	/**
+		@brief	頂点テクスチャの変更を転送する。
+	*/
+	virtual void FlushVertexTextures() = 0;
+
+	/**
+		@brief	統計情報を取得する。
+	*/
+	virtual RendererStatistics GetStatistics() const = 0;
 };
 
 //----------------------------------------------------------------------------------
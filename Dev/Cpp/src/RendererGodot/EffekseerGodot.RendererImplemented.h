@@ -10,6 +10,8 @@
 #include "EffekseerGodot.RenderState.h"
 #include "EffekseerGodot.VertexBuffer.h"
 #include "EffekseerGodot.IndexBuffer.h"
+#include <functional>
+#include <memory>
 
 namespace EffekseerGodot
 {
@@ -17,25 +19,139 @@ namespace EffekseerGodot
 //----------------------------------------------------------------------------------
 //
 //----------------------------------------------------------------------------------
+/**
+	@brief	ダイナミックメッシュ
+	@note	容量は増加のみ行い、毎フレームは書き込んだ範囲だけを部分更新する
+*/
+class DynamicMesh
+{
+public:
+	enum class Layout : uint8_t
+	{
+		Simple,	// Position, Color, UV
+		Full,	// Position, Normal, Tangent, Color, UV, UV2
+		Max
+	};
+
+	DynamicMesh();
+	~DynamicMesh();
+	int32_t Reserve(Layout layout, int32_t spriteCount);
+	void Update(const godot::PoolByteArray& vertexData, int32_t spriteCount, const godot::AABB& aabb);
+
+	godot::RID GetRID() { return m_mesh; }
+	int32_t GetCapacity() const { return m_capacity; }
+	int32_t GetSpriteCount() const { return m_spriteCount; }
+	const godot::AABB& GetAABB() const { return m_aabb; }
+
+	static int32_t GetStride(Layout layout);
+
+private:
+	void Allocate(Layout layout, int32_t capacity);
+
+	godot::RID m_mesh;
+	int32_t m_capacity = 0;
+	int32_t m_spriteCount = 0;
+	godot::AABB m_aabb;
+};
+
+enum MaterialTextureSlot : uint32_t
+{
+	MaterialTextureSlot_UVTangent,
+	MaterialTextureSlot_CustomData1,
+	MaterialTextureSlot_CustomData2,
+	MaterialTextureSlot_Max,
+};
+
+/**
+	@brief	マテリアルに設定済みのパラメータ
+	@note	変更のあったパラメータだけをVisualServerに送るために使う
+*/
+class MaterialParamCache
+{
+public:
+	/**
+		@brief	シェーダーを設定する (変更された場合は全パラメータを再設定する)
+		@return	シェーダーが変更されたかどうか
+	*/
+	bool BindShader(godot::RID shader, const void* owner, size_t valueSize)
+	{
+		if (m_shader == shader && m_owner == owner && m_values.size() == valueSize)
+		{
+			return false;
+		}
+		m_shader = shader;
+		m_owner = owner;
+		m_values.assign(valueSize, 0);
+		m_forced = true;
+		return true;
+	}
+
+	/**
+		@brief	値を比較して更新する
+		@return	値が変更されたかどうか
+	*/
+	bool Update(size_t offset, const void* value, size_t size)
+	{
+		uint8_t* dst = &m_values[offset];
+		if (!m_forced && memcmp(dst, value, size) == 0)
+		{
+			return false;
+		}
+		memcpy(dst, value, size);
+		return true;
+	}
+
+	void Commit() { m_forced = false; }
+
+	/**
+		@brief	頂点テクスチャの設定を比較して更新する
+		@return	設定が変更されたかどうか
+	*/
+	bool BindTexture(MaterialTextureSlot slot, godot::RID texture)
+	{
+		if (m_textures[slot] == texture) return false;
+		m_textures[slot] = texture;
+		return true;
+	}
+
+private:
+	godot::RID m_shader;
+	const void* m_owner = nullptr;
+	std::vector<uint8_t> m_values;
+	bool m_forced = true;
+	godot::RID m_textures[MaterialTextureSlot_Max];
+};
+
 /**
 	@brief	描画コマンド
 */
 class RenderCommand {
 public:
-	RenderCommand();
+	RenderCommand(GeometryUploadMode uploadMode);
 	~RenderCommand();
 	void Reset();
-	void DrawSprites(godot::World* world, int32_t priority);
+	void DrawSprites(godot::World* world, godot::RID geometry, int32_t priority);
 	void DrawModel(godot::World* world, godot::RID mesh, int32_t priority);
+	void DrawModelInstances(godot::World* world, godot::RID mesh, const godot::PoolRealArray& instanceData, 
+		int32_t capacity, int32_t instanceCount, int32_t priority);
 
+	GeometryUploadMode GetUploadMode() { return m_uploadMode; }
 	godot::RID GetImmediate() { return m_immediate; }
+	DynamicMesh& GetDynamicMesh(DynamicMesh::Layout layout) { return m_meshes[(size_t)layout]; }
 	godot::RID GetInstance() { return m_instance; }
 	godot::RID GetMaterial() { return m_material; }
+	MaterialParamCache& GetMaterialCache() { return m_materialCache; }
 
 private:
+	GeometryUploadMode m_uploadMode;
 	godot::RID m_immediate;
+	DynamicMesh m_meshes[(size_t)DynamicMesh::Layout::Max];
 	godot::RID m_instance;
 	godot::RID m_material;
+	MaterialParamCache m_materialCache;
+	godot::RID m_multimesh;
+	godot::RID m_multimeshMesh;
+	int32_t m_multimeshCapacity = 0;
 };
 
 /**
@@ -48,14 +164,145 @@ public:
 
 	void Reset();
 	void DrawSprites(godot::RID parentCanvasItem);
-	void DrawModel(godot::RID parentCanvasItem, godot::RID mesh);
+	void DrawModel(godot::RID parentCanvasItem, godot::RID mesh, const godot::Transform2D& transform);
 
 	godot::RID GetCanvasItem() { return m_canvasItem; }
 	godot::RID GetMaterial() { return m_material; }
+	MaterialParamCache& GetMaterialCache() { return m_materialCache; }
 
 private:
 	godot::RID m_canvasItem;
 	godot::RID m_material;
+	MaterialParamCache m_materialCache;
+};
+
+/**
+	@brief	描画コマンドプール
+	@note	チャンク単位で必要に応じて拡張し、一定期間使われなかった分を解放する
+*/
+template <class T>
+class RenderCommandPool
+{
+public:
+	static constexpr size_t ChunkSize = 32;
+	static constexpr int32_t ShrinkIntervalFrames = 600;
+
+	using Factory = std::function<std::unique_ptr<T>()>;
+
+	void Init(size_t maxCount, Factory factory)
+	{
+		m_maxCount = std::max(maxCount, (size_t)1);
+		m_factory = std::move(factory);
+		Resize(std::min(ChunkSize, m_maxCount));
+	}
+
+	void Clear()
+	{
+		m_commands.clear();
+		m_weights.clear();
+		m_count = 0;
+	}
+
+	/**
+		@brief	コマンドを確保する (上限に達している場合は-1)
+	*/
+	int32_t Allocate(int32_t weight)
+	{
+		if (m_count >= m_commands.size())
+		{
+			if (m_commands.size() >= m_maxCount)
+			{
+				return -1;
+			}
+			Resize(std::min(m_commands.size() + ChunkSize, m_maxCount));
+		}
+
+		size_t index = m_count++;
+		m_weights[index] = weight;
+		m_highWaterMark = std::max(m_highWaterMark, m_count);
+		return (int32_t)index;
+	}
+
+	/**
+		@brief	指定より軽いコマンドのうち最も軽いものを再利用する (無い場合は-1)
+	*/
+	int32_t Evict(int32_t weight)
+	{
+		size_t lowest = m_count;
+		for (size_t i = 0; i < m_count; i++)
+		{
+			if (m_weights[i] < weight && (lowest == m_count || m_weights[i] < m_weights[lowest]))
+			{
+				lowest = i;
+			}
+		}
+		if (lowest == m_count)
+		{
+			return -1;
+		}
+
+		m_commands[lowest]->Reset();
+		m_weights[lowest] = weight;
+		return (int32_t)lowest;
+	}
+
+	/**
+		@brief	使用中のコマンドをリセットする (フレーム開始時)
+	*/
+	void Reset()
+	{
+		for (size_t i = 0; i < m_count; i++)
+		{
+			m_commands[i]->Reset();
+		}
+
+		// Release the chunks which have not been used for a while
+		m_windowPeak = std::max(m_windowPeak, m_count);
+		if (++m_windowFrames >= ShrinkIntervalFrames)
+		{
+			size_t required = (m_windowPeak + ChunkSize - 1) / ChunkSize * ChunkSize;
+			required = std::min(std::max(required, ChunkSize), m_maxCount);
+			if (required < m_commands.size())
+			{
+				Resize(required);
+			}
+			m_windowPeak = 0;
+			m_windowFrames = 0;
+		}
+
+		m_count = 0;
+	}
+
+	void AddWeight(int32_t index, int32_t weight) { m_weights[index] += weight; }
+
+	T& operator[](size_t index) { return *m_commands[index]; }
+	bool IsFull() const { return m_count >= m_maxCount; }
+	size_t GetCount() const { return m_count; }
+	size_t GetAllocatedCount() const { return m_commands.size(); }
+	size_t GetHighWaterMark() const { return m_highWaterMark; }
+
+private:
+	void Resize(size_t size)
+	{
+		while (m_commands.size() > size)
+		{
+			m_commands.pop_back();
+		}
+		while (m_commands.size() < size)
+		{
+			m_commands.push_back(m_factory());
+		}
+		m_weights.resize(size);
+	}
+
+	Factory m_factory;
+	std::vector<std::unique_ptr<T>> m_commands;
+	std::vector<int32_t> m_weights;
+	size_t m_count = 0;
+	size_t m_maxCount = 0;
+	size_t m_highWaterMark = 0;
+	size_t m_windowPeak = 0;
+	int32_t m_windowFrames = 0;
 };
 
 //----------------------------------------------------------------------------------
@@ -79,15 +326,28 @@ public:
 
 	DynamicTexture();
 	~DynamicTexture();
-	void Init(int32_t width, int32_t height);
+	void Init(int32_t width, int32_t height, VertexTextureFormat format);
 	const LockedRect* Lock(int32_t x, int32_t y, int32_t width, int32_t height);
 	void Unlock();
 
+	/**
+		@brief	書き込まれた行をまとめて転送する
+	*/
+	void Flush();
+
 	godot::RID GetRID() { return m_imageTexture; }
 
 private:
 	godot::RID m_imageTexture;
-	godot::PoolByteArray m_rectData;
+	VertexTextureFormat m_format = VertexTextureFormat::RGBAF;
+	int32_t m_width = 0;
+	int32_t m_height = 0;
+
+	godot::PoolByteArray m_stagingData;
+	godot::PoolRealArray m_halfSource;
+	int32_t m_dirtyBegin = INT32_MAX;
+	int32_t m_dirtyEnd = 0;
+
 	LockedRect m_lockedRect{};
 };
 
@@ -114,16 +374,57 @@ private:
 	Shader* m_currentShader = nullptr;
 	godot::World* m_world = nullptr;
 
-	std::vector<RenderCommand> m_renderCommands;
-	size_t m_renderCount = 0;
-	std::vector<RenderCommand2D> m_renderCommand2Ds;
-	size_t m_renderCount2D = 0;
+	GeometryUploadMode m_uploadMode = GeometryUploadMode::Mesh;
+	DrawOverflowPolicy m_overflowPolicy = DrawOverflowPolicy::DropLowestPriority;
+	VertexTextureFormat m_vertexTextureFormat = VertexTextureFormat::RGBAF;
+	RenderCommandPool<RenderCommand> m_renderCommands;
+	RenderCommandPool<RenderCommand2D> m_renderCommand2Ds;
+	int32_t m_renderOrder = 0;
+	int64_t m_droppedDrawCount = 0;
+	int64_t m_mergedDrawCount = 0;
+
+	// The last sprite draw, which can take over draws exceeding the limit
+	struct MergeTarget
+	{
+		int32_t commandIndex = -1;
+		bool is2D = false;
+		godot::Object* node = nullptr;
+		Shader* shader = nullptr;
+		int32_t vertexTexturePageIndex = 0;
+		EffekseerRenderer::RenderStateBase::State renderState;
+		std::vector<uint8_t> constantBuffers;
+	};
+	MergeTarget m_mergeTarget;
 
 	Effekseer::ModelRef m_currentModel = nullptr;
-	DynamicTexture m_customData1Texture;
-	DynamicTexture m_customData2Texture;
-	DynamicTexture m_uvTangentTexture;
+	// Instance data of the current model batch and the constant buffer saved while drawing it per model
+	godot::PoolRealArray m_modelInstanceData;
+	std::vector<uint8_t> m_modelBatchConstants;
+	// Vertex textures are split into pages, a new page is added when the current one fills up
+	struct VertexTexturePage
+	{
+		DynamicTexture customData1;
+		DynamicTexture customData2;
+		DynamicTexture uvTangent;
+	};
+	std::vector<std::unique_ptr<VertexTexturePage>> m_vertexTexturePages;
+	int32_t m_vertexTexturePageIndex = 0;
 	int32_t m_vertexTextureOffset = 0;
+	int32_t m_vertexTextureUsedTexels = 0;
+	int64_t m_vertexTextureOverflowCount = 0;
+
+	// Reusable arrays for 2D drawing
+	struct CanvasScratch
+	{
+		int32_t capacity = 0;
+		godot::PoolIntArray indices;
+		godot::PoolVector2Array points;
+		godot::PoolColorArray colors;
+		godot::PoolVector2Array uvs;
+	};
+	static constexpr int32_t CanvasScratchMinSprites = 16;
+	std::vector<CanvasScratch> m_canvasScratches;
+	godot::PoolByteArray m_meshStaging;
 
 	std::unique_ptr<StandardRenderer> m_standardRenderer;
 	std::unique_ptr<RenderState> m_renderState;
@@ -134,7 +435,8 @@ public:
 	/**
 		@brief	コンストラクタ
 	*/
-	RendererImplemented(int32_t squareMaxCount);
+	RendererImplemented(int32_t squareMaxCount, GeometryUploadMode uploadMode, 
+		DrawOverflowPolicy overflowPolicy, VertexTextureFormat vertexTextureFormat);
 
 	/**
 		@brief	デストラクタ
@@ -162,6 +464,13 @@ public:
 	*/
 	void ResetState() override;
 
+	void FlushVertexTextures() override;
+
+	/**
+		@brief	統計情報
+	*/
+	RendererStatistics GetStatistics() const override;
+
 	/**
 		@brief	描画開始
 	*/
@@ -265,12 +574,47 @@ private:
 		const void* vertexData, int32_t spriteCount, 
 		const EffekseerRenderer::StandardRendererState& state);
 
+	void TransferVertexToMesh3D(DynamicMesh& mesh, DynamicMesh::Layout layout, 
+		const void* vertexData, int32_t spriteCount, 
+		const EffekseerRenderer::StandardRendererState& state, int32_t spriteOffset = 0);
+
 	void TransferVertexToCanvasItem2D(godot::RID canvas_item, 
 		const void* vertexData, int32_t spriteCount, 
 		const EffekseerRenderer::StandardRendererState& state);
 
 	void TransferModelToCanvasItem2D(godot::RID canvas_item, 
 		Effekseer::Model* model, const EffekseerRenderer::StandardRendererState& state);
+
+	void TransferModelInstances(int32_t instanceCount);
+
+	void DrawModelsPerInstance(int32_t vertexCount, int32_t indexCount, int32_t instanceCount);
+
+	CanvasScratch& GetCanvasScratch(int32_t spriteCount);
+
+	void AddVertexTexturePage();
+
+	VertexTexturePage& GetVertexTexturePage() { return *m_vertexTexturePages[m_vertexTexturePageIndex]; }
+
+	int32_t GetVertexTextureTexelCount(bool is2D, int32_t spriteCount, 
+		const EffekseerRenderer::StandardRendererState& state) const;
+
+	bool FitsInVertexTexturePage(int32_t texelCount) const;
+
+	bool CanAllocateVertexTexture(int32_t texelCount) const;
+
+	void AllocateVertexTexture(int32_t texelCount);
+
+	void BindVertexTextures(godot::RID material, MaterialParamCache& cache, 
+		bool is2D, const EffekseerRenderer::StandardRendererState& state);
+
+	template <class T>
+	int32_t AllocateCommand(RenderCommandPool<T>& pool, int32_t weight);
+
+	int32_t NextRenderPriority();
+
+	bool IsMergeable(godot::Object* node, bool is2D);
+
+	void SetMergeTarget(int32_t commandIndex, godot::Object* node, bool is2D);
 };
 
 //----------------------------------------------------------------------------------
@@ -1,5 +1,11 @@
 ﻿#include <VisualServer.hpp>
 #include <Texture.hpp>
+#include <OS.hpp>
+#include <algorithm>
+#include <mutex>
+#include <set>
+#include <tuple>
+#include <unordered_map>
 #include "EffekseerGodot.Shader.h"
 #include "../Utils/EffekseerGodot.Utils.h"
 
@@ -36,6 +42,63 @@ static const char* DepthWriteMode[] = {
 	"render_mode depth_draw_always;\n",
 };
 
+// Identifies a shader variant across sessions by the hash of the base code
+struct VariantKey
+{
+	uint32_t codeHash;
+	uint8_t renderType;
+	uint8_t dwm, dtm, cm, bm;
+
+	bool operator<(const VariantKey& rhs) const
+	{
+		return std::tie(codeHash, renderType, dwm, dtm, cm, bm) < 
+			std::tie(rhs.codeHash, rhs.renderType, rhs.dwm, rhs.dtm, rhs.cm, rhs.bm);
+	}
+
+	godot::String ToString() const
+	{
+		char str[32];
+		snprintf(str, sizeof(str), "%08x:%u:%u%u%u%u", codeHash, renderType, dwm, dtm, cm, bm);
+		return str;
+	}
+
+	bool FromString(const godot::String& str)
+	{
+		unsigned int hash, rt, w, t, c, b;
+		if (sscanf(str.utf8().get_data(), "%x:%u:%1u%1u%1u%1u", &hash, &rt, &w, &t, &c, &b) != 6 || 
+			rt >= (unsigned int)Shader::RenderType::Max || w >= 2 || t >= 2 || c >= 3 || b >= 5)
+		{
+			return false;
+		}
+		*this = { (uint32_t)hash, (uint8_t)rt, (uint8_t)w, (uint8_t)t, (uint8_t)c, (uint8_t)b };
+		return true;
+	}
+};
+
+static size_t GetParamValueSize(Shader::ParamType type)
+{
+	switch (type)
+	{
+	case Shader::ParamType::Int: return sizeof(int32_t);
+	case Shader::ParamType::Float: return sizeof(float);
+	case Shader::ParamType::Vector2: return sizeof(float) * 2;
+	case Shader::ParamType::Vector3: return sizeof(float) * 3;
+	case Shader::ParamType::Vector4: return sizeof(float) * 4;
+	case Shader::ParamType::Matrix44: return sizeof(Effekseer::Matrix44);
+	case Shader::ParamType::Color: return sizeof(float) * 4;
+	case Shader::ParamType::Texture: return sizeof(int64_t);
+	}
+	return 0;
+}
+
+static std::vector<Shader*> g_liveShaders;
+static std::mutex g_liveShadersMutex; // Materials may be compiled on the effect load thread
+static std::set<VariantKey> g_usedVariants;
+static std::set<VariantKey> g_pendingVariants;
+static bool g_prewarmScanNeeded = false; // Set when a pass may find something new to compile
+static std::unordered_map<int64_t, uint32_t> g_textureFlags;
+static std::mutex g_textureFlagsMutex; // Textures may be released on the effect load thread
+
 //-----------------------------------------------------------------------------------
 //
 //-----------------------------------------------------------------------------------
@@ -60,162 +123,272 @@ Shader::~Shader()
 {
 	auto vs = godot::VisualServer::get_singleton();
 
-#define COUNT_OF(list) (sizeof(list) / sizeof(list[0]))
-	for (int i = 0; i < (int)RenderType::Max; i++)
+	for (auto& shader : m_internals)
 	{
-		if ((RenderType)i == RenderType::CanvasItem)
-		{
-			for (size_t bm = 0; bm < COUNT_OF(BlendMode); bm++)
-			{
-				vs->free_rid(m_internals[i].rid[0][0][0][bm]);
-			}
-		}
-		else
+		godot::RID* rids = &shader.rid[0][0][0][0];
+		for (size_t i = 0; i < sizeof(shader.rid) / sizeof(godot::RID); i++)
 		{
-			for (size_t dwm = 0; dwm < COUNT_OF(DepthWriteMode); dwm++)
+			if (rids[i].is_valid())
 			{
-				for (size_t dtm = 0; dtm < COUNT_OF(DepthTestMode); dtm++)
-				{
-					for (size_t cm = 0; cm < COUNT_OF(CullMode); cm++)
-					{
-						for (size_t bm = 0; bm < COUNT_OF(BlendMode); bm++)
-						{
-							vs->free_rid(m_internals[i].rid[dwm][dtm][cm][bm]);
-						}
-					}
-				}
+				vs->free_rid(rids[i]);
 			}
 		}
 	}
-#undef COUNT_OF
+
+	std::lock_guard<std::mutex> lock(g_liveShadersMutex);
+	g_liveShaders.erase(std::remove(g_liveShaders.begin(), g_liveShaders.end(), this), g_liveShaders.end());
 }
 
 bool Shader::Compile(RenderType renderType, const char* code, std::vector<ParamDecl>&& paramDecls)
 {
-	auto vs = godot::VisualServer::get_singleton();
-
 	auto& shader = m_internals[(int)renderType];
 	shader.paramDecls = std::move(paramDecls);
 
-	godot::String baseCode = code;
+	// Parameter names are converted once and values are cached per material
+	shader.paramNames.clear();
+	shader.paramOffsets.clear();
+	shader.paramValueSize = 0;
+	for (auto& decl : shader.paramDecls)
+	{
+		shader.paramNames.push_back(godot::String(decl.name));
+		shader.paramOffsets.push_back(shader.paramValueSize);
+		shader.paramValueSize += (uint32_t)GetParamValueSize(decl.type);
+	}
+
+	// Variants are created on first use (or by prewarming)
+	shader.code = code;
+	shader.codeHash = shader.code.hash();
 
-#define COUNT_OF(list) (sizeof(list) / sizeof(list[0]))
+	std::lock_guard<std::mutex> lock(g_liveShadersMutex);
+	if (std::find(g_liveShaders.begin(), g_liveShaders.end(), this) == g_liveShaders.end())
+	{
+		g_liveShaders.push_back(this);
+	}
+	g_prewarmScanNeeded = true;
+	return true;
+}
+
+godot::RID Shader::GetVariant(RenderType renderType, size_t dwm, size_t dtm, size_t cm, size_t bm)
+{
+	auto& shader = m_internals[(int)renderType];
+	godot::RID& rid = shader.rid[dwm][dtm][cm][bm];
+	if (rid.is_valid())
+	{
+		return rid;
+	}
+
+	godot::String fullCode;
 	if (renderType == RenderType::CanvasItem)
 	{
-		for (size_t bm = 0; bm < COUNT_OF(BlendMode); bm++)
-		{
-			godot::String fullCode;
-			fullCode += ShaderType2D;
-			fullCode += BlendMode[bm];
-			fullCode += baseCode;
+		fullCode += ShaderType2D;
+		fullCode += BlendMode[bm];
+		fullCode += shader.code;
+	}
+	else
+	{
+		fullCode += ShaderType3D;
+		fullCode += DepthWriteMode[dwm];
+		fullCode += DepthTestMode[dtm];
+		fullCode += CullMode[cm];
+		fullCode += BlendMode[bm];
+		fullCode += shader.code;
+	}
+
+	auto vs = godot::VisualServer::get_singleton();
+	rid = vs->shader_create();
+	vs->shader_set_code(rid, fullCode);
+
+	VariantKey key = { shader.codeHash, (uint8_t)renderType, (uint8_t)dwm, (uint8_t)dtm, (uint8_t)cm, (uint8_t)bm };
+	g_usedVariants.insert(key);
+	g_pendingVariants.erase(key);
+
+	return rid;
+}
 
-			shader.rid[0][0][0][bm] = vs->shader_create();
-			vs->shader_set_code(shader.rid[0][0][0][bm], fullCode);
+godot::PoolStringArray Shader::GetUsedVariants()
+{
+	godot::PoolStringArray result;
+	for (auto& key : g_usedVariants)
+	{
+		result.append(key.ToString());
+	}
+	return result;
+}
+
+void Shader::AddPrewarmVariants(const godot::PoolStringArray& variants)
+{
+	std::lock_guard<std::mutex> lock(g_liveShadersMutex);
+	for (int i = 0; i < variants.size(); i++)
+	{
+		VariantKey key;
+		if (key.FromString(variants[i]) && g_usedVariants.find(key) == g_usedVariants.end())
+		{
+			g_pendingVariants.insert(key);
 		}
 	}
-	else
+	g_prewarmScanNeeded = true;
+}
+
+int32_t Shader::PrewarmVariants(int64_t budgetUsec)
+{
+	auto os = godot::OS::get_singleton();
+	const int64_t startTime = os->get_ticks_usec();
+
+	std::lock_guard<std::mutex> lock(g_liveShadersMutex);
+
+	// Variants of shaders which never get loaded would otherwise be rescanned every frame
+	if (!g_prewarmScanNeeded)
+	{
+		return (int32_t)g_pendingVariants.size();
+	}
+
+	bool completedPass = true;
+	for (auto it = g_pendingVariants.begin(); it != g_pendingVariants.end(); )
 	{
-		for (size_t dwm = 0; dwm < COUNT_OF(DepthWriteMode); dwm++)
+		// Variants of shaders which are not loaded yet remain pending
+		auto key = *it++;
+		for (auto shader : g_liveShaders)
 		{
-			for (size_t dtm = 0; dtm < COUNT_OF(DepthTestMode); dtm++)
+			if (shader->m_internals[key.renderType].codeHash == key.codeHash && 
+				shader->m_internals[key.renderType].code.length() > 0)
 			{
-				for (size_t cm = 0; cm < COUNT_OF(CullMode); cm++)
-				{
-					for (size_t bm = 0; bm < COUNT_OF(BlendMode); bm++)
-					{
-						godot::String fullCode;
-						fullCode += ShaderType3D;
-						fullCode += DepthWriteMode[dwm];
-						fullCode += DepthTestMode[dtm];
-						fullCode += CullMode[cm];
-						fullCode += BlendMode[bm];
-						fullCode += baseCode;
-
-						shader.rid[dwm][dtm][cm][bm] = vs->shader_create();
-						vs->shader_set_code(shader.rid[dwm][dtm][cm][bm], fullCode);
-					}
-				}
+				shader->GetVariant((RenderType)key.renderType, key.dwm, key.dtm, key.cm, key.bm);
+				break;
 			}
 		}
+
+		if (os->get_ticks_usec() - startTime >= budgetUsec)
+		{
+			completedPass = it == g_pendingVariants.end();
+			break;
+		}
 	}
-#undef COUNT_OF
-	return true;
+
+	// A full pass has compiled everything available, wait for more shaders to be loaded
+	if (completedPass)
+	{
+		g_prewarmScanNeeded = false;
+	}
+
+	return (int32_t)g_pendingVariants.size();
 }
 
 //-----------------------------------------------------------------------------------
 //
 //-----------------------------------------------------------------------------------
-void Shader::ApplyToMaterial(RenderType renderType, godot::RID material, EffekseerRenderer::RenderStateBase::State& state)
+void Shader::ApplyToMaterial(RenderType renderType, godot::RID material, MaterialParamCache& cache, 
+	EffekseerRenderer::RenderStateBase::State& state)
 {
 	auto vs = godot::VisualServer::get_singleton();
 
 	auto& shader = m_internals[(int)renderType];
 	const size_t bm = (size_t)state.AlphaBlend;
 	
+	godot::RID variant;
 	if (renderType == RenderType::CanvasItem)
 	{
-		vs->material_set_shader(material, shader.rid[0][0][0][bm]);
+		variant = GetVariant(renderType, 0, 0, 0, bm);
 	}
 	else
 	{
 		const size_t cm = (size_t)state.CullingType;
 		const size_t dtm = (size_t)state.DepthTest;
 		const size_t dwm = (size_t)state.DepthWrite;
-		vs->material_set_shader(material, shader.rid[dwm][dtm][cm][bm]);
+		variant = GetVariant(renderType, dwm, dtm, cm, bm);
 	}
 
+	if (cache.BindShader(variant, &shader, shader.paramValueSize))
+	{
+		vs->material_set_shader(material, variant);
+	}
+
+	// Only the parameters changed since the last draw with this material are sent
 	for (size_t i = 0; i < shader.paramDecls.size(); i++)
 	{
 		const auto& decl = shader.paramDecls[i];
+		const auto& name = shader.paramNames[i];
+		const uint8_t* src = &m_constantBuffers[decl.slot][decl.offset];
+		const size_t offset = shader.paramOffsets[i];
 
 		if (decl.type == ParamType::Int)
 		{
-			auto value = *(const int32_t*)&m_constantBuffers[decl.slot][decl.offset];
-			vs->material_set_param(material, decl.name, value);
+			if (!cache.Update(offset, src, sizeof(int32_t))) continue;
+			auto value = *(const int32_t*)src;
+			vs->material_set_param(material, name, value);
 		}
 		else if (decl.type == ParamType::Float)
 		{
-			auto value = *(const float*)&m_constantBuffers[decl.slot][decl.offset];
-			vs->material_set_param(material, decl.name, value);
+			if (!cache.Update(offset, src, sizeof(float))) continue;
+			auto value = *(const float*)src;
+			vs->material_set_param(material, name, value);
 		}
 		else if (decl.type == ParamType::Vector2)
 		{
-			auto& vector = *(const godot::Vector2*)&m_constantBuffers[decl.slot][decl.offset];
-			vs->material_set_param(material, decl.name, vector);
+			if (!cache.Update(offset, src, sizeof(float) * 2)) continue;
+			auto& vector = *(const godot::Vector2*)src;
+			vs->material_set_param(material, name, vector);
 		}
 		else if (decl.type == ParamType::Vector3)
 		{
-			auto& vector = *(const godot::Vector3*)&m_constantBuffers[decl.slot][decl.offset];
-			vs->material_set_param(material, decl.name, vector);
+			if (!cache.Update(offset, src, sizeof(float) * 3)) continue;
+			auto& vector = *(const godot::Vector3*)src;
+			vs->material_set_param(material, name, vector);
 		}
 		else if (decl.type == ParamType::Vector4)
 		{
-			auto& vector = *(const godot::Quat*)&m_constantBuffers[decl.slot][decl.offset];
-			//auto& vector = *(const godot::Color*)&m_constantBuffers[decl.slot][decl.offset];
-			vs->material_set_param(material, decl.name, vector);
+			if (!cache.Update(offset, src, sizeof(float) * 4)) continue;
+			auto& vector = *(const godot::Quat*)src;
+			//auto& vector = *(const godot::Color*)src;
+			vs->material_set_param(material, name, vector);
 		}
 		else if (decl.type == ParamType::Color)
 		{
-			auto& vector = *(const godot::Color*)&m_constantBuffers[decl.slot][decl.offset];
-			vs->material_set_param(material, decl.name, vector);
+			if (!cache.Update(offset, src, sizeof(float) * 4)) continue;
+			auto& vector = *(const godot::Color*)src;
+			vs->material_set_param(material, name, vector);
 		}
 		else if (decl.type == ParamType::Matrix44)
 		{
-			auto& matrix = *(const Effekseer::Matrix44*)&m_constantBuffers[decl.slot][decl.offset];
-			vs->material_set_param(material, decl.name, ToGdMatrix(matrix));
+			if (!cache.Update(offset, src, sizeof(Effekseer::Matrix44))) continue;
+			auto& matrix = *(const Effekseer::Matrix44*)src;
+			vs->material_set_param(material, name, ToGdMatrix(matrix));
 		}
 		else if (decl.type == ParamType::Texture)
 		{
 			godot::RID texture = Int64ToRID((int64_t)state.TextureIDs[decl.slot]);
 			if (texture.is_valid())
 			{
-				vs->texture_set_flags(texture, godot::Texture::FLAG_MIPMAPS | 
+				const uint32_t flags = godot::Texture::FLAG_MIPMAPS | 
 					((state.TextureFilterTypes[decl.slot] == Effekseer::TextureFilterType::Linear) ? godot::Texture::FLAG_FILTER : 0) | 
-					((state.TextureWrapTypes[decl.slot] == Effekseer::TextureWrapType::Repeat) ? godot::Texture::FLAG_REPEAT : 0));
-				vs->material_set_param(material, decl.name, texture);
+					((state.TextureWrapTypes[decl.slot] == Effekseer::TextureWrapType::Repeat) ? godot::Texture::FLAG_REPEAT : 0);
+				
+				// Flags are set only when the sampler state of the texture changes
+				std::unique_lock<std::mutex> flagsLock(g_textureFlagsMutex);
+				auto result = g_textureFlags.emplace(texture.get_id(), flags);
+				const bool flagsChanged = result.second || result.first->second != flags;
+				result.first->second = flags;
+				flagsLock.unlock();
+
+				if (flagsChanged)
+				{
+					vs->texture_set_flags(texture, flags);
+				}
+
+				if (cache.Update(offset, &state.TextureIDs[decl.slot], sizeof(state.TextureIDs[decl.slot])))
+				{
+					vs->material_set_param(material, name, texture);
+				}
 			}
 		}
 	}
+
+	cache.Commit();
+}
+
+void Shader::ForgetTextureFlags(godot::RID texture)
+{
+	std::lock_guard<std::mutex> lock(g_textureFlagsMutex);
+	g_textureFlags.erase(texture.get_id());
 }
 
 //-----------------------------------------------------------------------------------
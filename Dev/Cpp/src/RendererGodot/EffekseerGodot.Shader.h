@@ -22,6 +22,8 @@ public:
 		SpatialLightweight,
 		SpatialDepthFade,
 		CanvasItem,
+		SpatialLightweightInstanced,
+		SpatialDepthFadeInstanced,
 		Max
 	};
 
@@ -87,23 +89,59 @@ public:
 
 	void SetConstantBuffer() {}
 
-	void ApplyToMaterial(RenderType renderType, godot::RID material, EffekseerRenderer::RenderStateBase::State& state);
+	/**
+		@brief	頂点定数バッファに含まれるモデルのインスタンス数を設定する。
+	*/
+	void SetInstanceCount(int32_t count) { m_instanceCount = count; }
+	int32_t GetInstanceCount() const { return m_instanceCount; }
+
+	void ApplyToMaterial(RenderType renderType, godot::RID material, MaterialParamCache& cache, 
+		EffekseerRenderer::RenderStateBase::State& state);
 
 	EffekseerRenderer::RendererShaderType GetShaderType() { return m_shaderType; }
 
+	/**
+		@brief	これまでに使用されたシェーダーバリエーションの一覧を取得する。
+	*/
+	static godot::PoolStringArray GetUsedVariants();
+
+	/**
+		@brief	事前にコンパイルするシェーダーバリエーションを追加する。
+	*/
+	static void AddPrewarmVariants(const godot::PoolStringArray& variants);
+
+	/**
+		@brief	指定時間内で事前コンパイルを進める。
+		@return	未処理のバリエーション数
+	*/
+	static int32_t PrewarmVariants(int64_t budgetUsec);
+
+	/**
+		@brief	テクスチャに設定したフラグの記録を破棄する。
+	*/
+	static void ForgetTextureFlags(godot::RID texture);
+
 private:
 	std::vector<uint8_t> m_constantBuffers[2];
 
 	std::string m_name;
 	EffekseerRenderer::RendererShaderType m_shaderType = EffekseerRenderer::RendererShaderType::Unlit;
+	int32_t m_instanceCount = 1;
 
 	struct InternalShader {
+		godot::String code;
+		uint32_t codeHash = 0;
 		godot::RID rid[2][2][3][5];
 		std::vector<ParamDecl> paramDecls;
+		std::vector<godot::String> paramNames;
+		std::vector<uint32_t> paramOffsets;
+		uint32_t paramValueSize = 0;
 	};
 	InternalShader m_internals[(size_t)RenderType::Max];
 
 	Shader(const char* name, EffekseerRenderer::RendererShaderType shaderType);
+
+	godot::RID GetVariant(RenderType renderType, size_t dwm, size_t dtm, size_t cm, size_t bm);
 };
 
 //----------------------------------------------------------------------------------
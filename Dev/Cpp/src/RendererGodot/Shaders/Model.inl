@@ -8,10 +8,15 @@ render_mode unshaded;
 
 R"(
 uniform mat4 ViewMatrix;
+)"
+
+#if !INSTANCING
+R"(
 uniform mat4 ModelMatrix;
 uniform vec4 ModelUV;
 uniform vec4 ModelColor : hint_color;
 )"
+#endif
 
 #if DISTORTION
 
@@ -41,6 +46,15 @@ uniform vec4 SoftParticleReco;
 
 #include "Common3D.inl"
 
+#if INSTANCING
+// Transform, color and UV come from the MultiMesh instance data
+R"(
+void vertex() {
+	MODELVIEW_MATRIX = ViewMatrix * WORLD_MATRIX;
+	UV = (UV.xy * INSTANCE_CUSTOM.zw) + INSTANCE_CUSTOM.xy;
+}
+)"
+#else
 R"(
 void vertex() {
 	MODELVIEW_MATRIX = ViewMatrix * ModelMatrix;
@@ -48,6 +62,7 @@ void vertex() {
 	COLOR = COLOR * ModelColor;
 }
 )"
+#endif
 
 R"(
 void fragment() {
@@ -84,9 +99,11 @@ R"(
 
 const Shader::ParamDecl decl[] = {
 	{ "ViewMatrix",  Shader::ParamType::Matrix44, 0,   0 },
+#if !INSTANCING
 	{ "ModelMatrix", Shader::ParamType::Matrix44, 0,  64 },
 	{ "ModelUV",     Shader::ParamType::Vector4,  0, 128 },
 	{ "ModelColor",  Shader::ParamType::Vector4,  0, 144 },
+#endif
 
 #if DISTORTION
 	{ "DistortionIntensity", Shader::ParamType::Float, 1, 48 },
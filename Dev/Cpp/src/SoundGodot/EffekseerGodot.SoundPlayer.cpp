@@ -1,4 +1,5 @@
 ﻿#include <AudioServer.hpp>
+#include <algorithm>
 #include "EffekseerGodot.SoundPlayer.h"
 #include "EffekseerGodot.SoundResources.h"
 #include "../Utils/EffekseerGodot.Utils.h"
@@ -17,11 +18,31 @@ SoundPlayer::~SoundPlayer()
 
 Effekseer::SoundHandle SoundPlayer::Play(Effekseer::SoundTag tag, const InstanceParameter& parameter)
 {
+	if (deferred_)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto handle = reinterpret_cast<Effekseer::SoundHandle>(nextHandle_++);
+		commands_.push_back({ CommandType::Play, false, handle, tag, parameter });
+		return handle;
+	}
+
+	return reinterpret_cast<Effekseer::SoundHandle>((size_t)PlayImmediate(tag, parameter));
+}
+
+int64_t SoundPlayer::PlayImmediate(Effekseer::SoundTag tag, const InstanceParameter& parameter)
+{
+	// The player is added as a child of the emitter
+	auto emitter = reinterpret_cast<godot::Object*>(parameter.UserData);
+	if (emitter == nullptr)
+	{
+		return 0;
+	}
+
 	auto data = (SoundData*)parameter.Data.Get();
 
 	godot::Dictionary args;
 	args["tag"] = reinterpret_cast<int64_t>(tag);
-	args["emitter"] = reinterpret_cast<godot::Object*>(parameter.UserData);
+	args["emitter"] = emitter;
 	args["stream"] = data->GetStream();
 	args["volume"] = parameter.Volume;
 	args["pitch"] = parameter.Pitch;
@@ -30,43 +51,152 @@ Effekseer::SoundHandle SoundPlayer::Play(Effekseer::SoundTag tag, const Instance
 	args["position"] = ToGdVector3(parameter.Position);
 	args["distance"] = parameter.Distance;
 
-	auto result = (size_t)(int64_t)soundContext_->call("play", args);
-	return reinterpret_cast<Effekseer::SoundHandle>((size_t)result);
+	return (int64_t)soundContext_->call("play", args);
 }
 
 void SoundPlayer::Stop(Effekseer::SoundHandle handle, Effekseer::SoundTag tag)
 {
+	if (deferred_)
+	{
+		Push({ CommandType::Stop, false, handle, tag });
+		return;
+	}
 	soundContext_->call("stop", reinterpret_cast<int64_t>(handle));
 }
 
 void SoundPlayer::Pause(Effekseer::SoundHandle handle, Effekseer::SoundTag tag, bool pause)
 {
+	if (deferred_)
+	{
+		Push({ CommandType::Pause, pause, handle, tag });
+		return;
+	}
 	soundContext_->call("pause", reinterpret_cast<int64_t>(handle), pause);
 }
 
 bool SoundPlayer::CheckPlaying(Effekseer::SoundHandle handle, Effekseer::SoundTag tag)
 {
+	if (deferred_)
+	{
+		// The script can't be called from the update thread, so known sounds are treated as playing
+		std::lock_guard<std::mutex> lock(mutex_);
+		return handles_.find(reinterpret_cast<size_t>(handle)) != handles_.end() || 
+			std::any_of(commands_.begin(), commands_.end(), [handle](const Command& c) { 
+				return c.type == CommandType::Play && c.handle == handle; });
+	}
 	return (bool)soundContext_->call("check_playing", reinterpret_cast<int64_t>(handle));
 }
 
 void SoundPlayer::StopTag(Effekseer::SoundTag tag)
 {
+	if (deferred_)
+	{
+		Push({ CommandType::StopTag, false, nullptr, tag });
+		return;
+	}
 	soundContext_->call("stop_tag", reinterpret_cast<int64_t>(tag));
 }
 
 void SoundPlayer::PauseTag(Effekseer::SoundTag tag, bool pause)
 {
+	if (deferred_)
+	{
+		Push({ CommandType::PauseTag, pause, nullptr, tag });
+		return;
+	}
 	soundContext_->call("pause_tag", reinterpret_cast<int64_t>(tag), pause);
 }
 
 bool SoundPlayer::CheckPlayingTag(Effekseer::SoundTag tag)
 {
+	if (deferred_)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return std::any_of(handles_.begin(), handles_.end(), [tag](const std::pair<const size_t, DeferredSound>& h) { 
+				return h.second.tag == tag; }) || 
+			std::any_of(commands_.begin(), commands_.end(), [tag](const Command& c) { 
+				return c.type == CommandType::Play && c.tag == tag; });
+	}
 	return (bool)soundContext_->call("check_playing_tag", reinterpret_cast<int64_t>(tag));
 }
 
 void SoundPlayer::StopAll()
 {
+	if (deferred_)
+	{
+		Push({ CommandType::StopAll, false, nullptr, nullptr });
+		return;
+	}
 	soundContext_->call("stop_all");
 }
 
+void SoundPlayer::Push(const Command& command)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	commands_.push_back(command);
+}
+
+int64_t SoundPlayer::ToScriptHandle(Effekseer::SoundHandle handle) const
+{
+	auto it = handles_.find(reinterpret_cast<size_t>(handle));
+	return (it != handles_.end()) ? it->second.scriptHandle : 0;
+}
+
+// Called on the main thread while no update is running
+void SoundPlayer::Flush()
+{
+	std::vector<Command> commands;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		commands.swap(commands_);
+	}
+	if (commands.empty() && handles_.empty())
+	{
+		return;
+	}
+
+	// Forget sounds which have finished by themselves since the last flush
+	for (auto it = handles_.begin(); it != handles_.end(); )
+	{
+		if ((bool)soundContext_->call("check_playing", it->second.scriptHandle)) ++it;
+		else it = handles_.erase(it);
+	}
+
+	for (auto& command : commands)
+	{
+		switch (command.type)
+		{
+		case CommandType::Play:
+			// Sounds the script did not play are not kept, they are never playing
+			if (int64_t scriptHandle = PlayImmediate(command.tag, command.parameter))
+			{
+				handles_[reinterpret_cast<size_t>(command.handle)] = { scriptHandle, command.tag };
+			}
+			break;
+		case CommandType::Stop:
+			soundContext_->call("stop", ToScriptHandle(command.handle));
+			handles_.erase(reinterpret_cast<size_t>(command.handle));
+			break;
+		case CommandType::Pause:
+			soundContext_->call("pause", ToScriptHandle(command.handle), command.pause);
+			break;
+		case CommandType::StopTag:
+			soundContext_->call("stop_tag", reinterpret_cast<int64_t>(command.tag));
+			for (auto it = handles_.begin(); it != handles_.end(); )
+			{
+				if (it->second.tag == command.tag) it = handles_.erase(it);
+				else ++it;
+			}
+			break;
+		case CommandType::PauseTag:
+			soundContext_->call("pause_tag", reinterpret_cast<int64_t>(command.tag), command.pause);
+			break;
+		case CommandType::StopAll:
+			soundContext_->call("stop_all");
+			handles_.clear();
+			break;
+		}
+	}
+}
+
 } // namespace EffekseerGodot
@@ -1,6 +1,9 @@
 ﻿#pragma once
 
 #include <stdint.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 #include <Effekseer.h>
 #include <Reference.hpp>
 
@@ -33,8 +36,46 @@ public:
 
 	virtual void StopAll() override;
 
+	// While deferred, calls are queued and sent to the sound script by Flush() on the main thread
+	void SetDeferred(bool deferred) { deferred_ = deferred; }
+
+	void Flush();
+
 private:
+	enum class CommandType : uint8_t
+	{
+		Play, Stop, Pause, StopTag, PauseTag, StopAll,
+	};
+
+	struct Command
+	{
+		CommandType type;
+		bool pause;
+		Effekseer::SoundHandle handle;
+		Effekseer::SoundTag tag;
+		InstanceParameter parameter;
+	};
+
+	struct DeferredSound
+	{
+		int64_t scriptHandle;
+		Effekseer::SoundTag tag;
+	};
+
+	int64_t PlayImmediate(Effekseer::SoundTag tag, const InstanceParameter& parameter);
+
+	int64_t ToScriptHandle(Effekseer::SoundHandle handle) const;
+
+	void Push(const Command& command);
+
 	godot::Ref<godot::Reference> soundContext_;
+
+	bool deferred_ = false;
+	std::mutex mutex_;
+	std::vector<Command> commands_;
+	// Handles given out while deferred and the sounds they were played with
+	std::unordered_map<size_t, DeferredSound> handles_;
+	size_t nextHandle_ = 1;
 };
 
 }
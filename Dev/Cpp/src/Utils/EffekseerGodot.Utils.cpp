@@ -73,4 +73,18 @@ godot::Variant ScriptNew(godot::Ref<godot::Script> script)
 	return Variant();
 }
 
+void RemoveFinishedHandles(const Effekseer::ManagerRef& manager, std::vector<Effekseer::Handle>& handles)
+{
+	// Swap-remove in one pass, the order of the handles is not kept
+	size_t count = handles.size();
+	for (size_t i = 0; i < count; ) {
+		if (manager->Exists(handles[i])) {
+			i++;
+		} else {
+			handles[i] = handles[--count];
+		}
+	}
+	handles.resize(count);
+}
+
 } // namespace EffekseerGodot
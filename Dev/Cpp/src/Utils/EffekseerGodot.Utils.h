@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include <stdint.h>
+#include <vector>
 #include <Effekseer.h>
 #include <String.hpp>
 #include <RID.hpp>
@@ -166,4 +167,6 @@ godot::String ToGdString(const char16_t* from);
 
 godot::Variant ScriptNew(godot::Ref<godot::Script> script);
 
+void RemoveFinishedHandles(const Effekseer::ManagerRef& manager, std::vector<Effekseer::Handle>& handles);
+
 }
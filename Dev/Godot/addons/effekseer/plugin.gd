@@ -10,7 +10,22 @@ const plugin_source_path = "res://addons/effekseer/src"
 func _enter_tree():
 	add_project_setting("effekseer/instance_max_count", 2000, TYPE_INT, PROPERTY_HINT_RANGE, "40,8000")
 	add_project_setting("effekseer/square_max_count", 8000, TYPE_INT, PROPERTY_HINT_RANGE, "80,32000")
-	add_project_setting("effekseer/draw_max_count", 128, TYPE_INT, PROPERTY_HINT_RANGE, "16,1024")
+	add_project_setting("effekseer/draw_max_count", 1024, TYPE_INT, PROPERTY_HINT_RANGE, "16,8192")
+	add_project_setting("effekseer/draw_overflow_policy", 0, TYPE_INT, PROPERTY_HINT_ENUM, "Drop Lowest Priority,Merge")
+	add_project_setting("effekseer/geometry_upload_mode", 0, TYPE_INT, PROPERTY_HINT_ENUM, "Mesh,Immediate")
+	add_project_setting("effekseer/vertex_texture_format", 0, TYPE_INT, PROPERTY_HINT_ENUM, "RGBAF,RGBAH")
+	add_project_setting("effekseer/shader_prewarm_list", "", TYPE_STRING, PROPERTY_HINT_FILE, "*.txt")
+	add_project_setting("effekseer/shader_prewarm_budget_ms", 2.0, TYPE_REAL, PROPERTY_HINT_RANGE, "0.1,16.0")
+	add_project_setting("effekseer/update_tick_rate", 60.0, TYPE_REAL, PROPERTY_HINT_RANGE, "10.0,240.0")
+	add_project_setting("effekseer/update_max_steps", 4, TYPE_INT, PROPERTY_HINT_RANGE, "1,16")
+	add_project_setting("effekseer/update_budget_usec", 0, TYPE_INT, PROPERTY_HINT_RANGE, "0,16000")
+	add_project_setting("effekseer/worker_thread_count", -1, TYPE_INT, PROPERTY_HINT_RANGE, "-1,32")
+	add_project_setting("effekseer/layers", PoolStringArray(), TYPE_STRING_ARRAY, PROPERTY_HINT_NONE, "")
+	add_project_setting("effekseer/async_update", false, TYPE_BOOL, PROPERTY_HINT_NONE, "")
+	add_project_setting("effekseer/culling_world_size", 1000.0, TYPE_REAL, PROPERTY_HINT_RANGE, "0.0,100000.0")
+	add_project_setting("effekseer/async_effect_setup", false, TYPE_BOOL, PROPERTY_HINT_NONE, "")
+	add_project_setting("effekseer/effect_load_budget_ms", 2.0, TYPE_REAL, PROPERTY_HINT_RANGE, "0.1,16.0")
+	add_project_setting("effekseer/release_data_after_setup", false, TYPE_BOOL, PROPERTY_HINT_NONE, "")
 	add_project_setting("effekseer/sound_script", load(plugin_source_path + "/EffekseerSound.gd"), TYPE_OBJECT, PROPERTY_HINT_RESOURCE_TYPE, "Script")
 	
 	add_autoload_singleton("EffekseerSystem", plugin_source_path + "/EffekseerSystem.gdns")
@@ -38,6 +53,21 @@ func _exit_tree():
 	remove_autoload_singleton("EffekseerSystem")
 
 	remove_project_setting("effekseer/sound_script")
+	remove_project_setting("effekseer/release_data_after_setup")
+	remove_project_setting("effekseer/effect_load_budget_ms")
+	remove_project_setting("effekseer/async_effect_setup")
+	remove_project_setting("effekseer/culling_world_size")
+	remove_project_setting("effekseer/async_update")
+	remove_project_setting("effekseer/layers")
+	remove_project_setting("effekseer/worker_thread_count")
+	remove_project_setting("effekseer/update_budget_usec")
+	remove_project_setting("effekseer/update_max_steps")
+	remove_project_setting("effekseer/update_tick_rate")
+	remove_project_setting("effekseer/shader_prewarm_budget_ms")
+	remove_project_setting("effekseer/shader_prewarm_list")
+	remove_project_setting("effekseer/vertex_texture_format")
+	remove_project_setting("effekseer/geometry_upload_mode")
+	remove_project_setting("effekseer/draw_overflow_policy")
 	remove_project_setting("effekseer/draw_max_count")
 	remove_project_setting("effekseer/square_max_count")
 	remove_project_setting("effekseer/instance_max_count")